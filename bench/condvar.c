@@ -0,0 +1,345 @@
+#define _GNU_SOURCE // for syscall()
+
+// Condition variables under three usage patterns, for each cond backend.
+//
+// - queue: producers and consumers over a bounded buffer of -q slots
+// - barrier: all threads meet, the last one to arrive broadcasts
+// - pool: a submitter hands batches of tasks to idle workers and waits
+//   for each batch to finish
+//
+// The backends are the vendored glibc condvar with and without speculation
+// (pthread_tm and pthread, TM_COND_VARS) and the semaphore queue of
+// txcond.c (sem). Each row gives operations per second, percentiles of the
+// time from tc_signal or tc_broadcast to the waiter returning from
+// tc_wait, and futex syscalls and sleeps per operation. Futex calls are
+// counted with the syscall tracepoint, which needs perf_event_paranoid
+// <= 1 or root; the column is left empty otherwise.
+//
+// Like bench/locks, every lock type runs in a child process of its own.
+// Without RTM the _tm types, tas_hle and the pthread_tm backend are left out.
+//
+// usage: bench/condvar [-l locks] [-b backends] [-t threads] [-n ops] [-q slots]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+
+#include "txlock.h"
+#include "txutil.h" // for the cond backends
+#include "harness.h"
+
+#define MAX_SAMPLES (1 << 20)
+
+typedef struct {
+    txcond_t cv;
+    volatile uint64_t signaled_at;
+} cond_t;
+
+static txlock_t lock;
+static cond_t not_empty, not_full, done;
+static uint64_t *samples;
+static volatile int64_t num_samples;
+
+static int threads = 4;
+static long ops = 100000;
+static int slots = 16;
+
+static int64_t now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000000L + t.tv_nsec;
+}
+
+// callers hold lock
+static void wait_on(cond_t *c) {
+    tc_wait(&c->cv, &lock);
+    int64_t i = __sync_fetch_and_add(&num_samples, 1);
+    if (i < MAX_SAMPLES)
+        samples[i] = rdtsc() - c->signaled_at;
+}
+
+static void signal_on(cond_t *c) {
+    c->signaled_at = rdtsc();
+    tc_signal(&c->cv);
+}
+
+static void broadcast_on(cond_t *c) {
+    c->signaled_at = rdtsc();
+    tc_broadcast(&c->cv);
+}
+
+// queue =========================
+
+static long *buffer;
+static int head, count;
+static long produced, consumed;
+
+static void* producer(void* arg) {
+    long n = (intptr_t)arg;
+    for (long i=0; i<n; i++) {
+        tl_lock(&lock);
+        while (count == slots)
+            wait_on(&not_full);
+        buffer[(head + count++) % slots] = i;
+        produced++;
+        signal_on(&not_empty);
+        tl_unlock(&lock);
+    }
+    return NULL;
+}
+
+static void* consumer(void* arg) {
+    for (;;) {
+        tl_lock(&lock);
+        while (count == 0 && consumed < ops)
+            wait_on(&not_empty);
+        if (consumed == ops) {
+            tl_unlock(&lock);
+            return NULL;
+        }
+        head = (head + 1) % slots;
+        count--;
+        if (++consumed == ops)
+            broadcast_on(&not_empty); // the other consumers are done too
+        signal_on(&not_full);
+        tl_unlock(&lock);
+    }
+}
+
+static long run_queue() {
+    int p = threads/2 > 0 ? threads/2 : 1;
+    int c = threads - p > 0 ? threads - p : 1;
+    pthread_t tids[p + c];
+    head = count = 0;
+    produced = consumed = 0;
+    for (int i=0; i<p; i++)
+        pthread_create(&tids[i], NULL, producer, (void*)(intptr_t)(ops/p + (i < ops%p)));
+    for (int i=0; i<c; i++)
+        pthread_create(&tids[p + i], NULL, consumer, NULL);
+    for (int i=0; i<p + c; i++)
+        pthread_join(tids[i], NULL);
+    if (produced != ops || consumed != ops) {
+        fprintf(stderr, "queue: produced %ld and consumed %ld of %ld\n", produced, consumed, ops);
+        exit(1);
+    }
+    return ops;
+}
+
+// barrier =========================
+
+static int arrived;
+static volatile long generation;
+
+static void* barrier_thread(void* arg) {
+    long rounds = (intptr_t)arg;
+    for (long r=0; r<rounds; r++) {
+        tl_lock(&lock);
+        long gen = generation;
+        if (++arrived == threads) {
+            arrived = 0;
+            generation++;
+            broadcast_on(&not_empty);
+        } else {
+            while (generation == gen)
+                wait_on(&not_empty);
+        }
+        tl_unlock(&lock);
+    }
+    return NULL;
+}
+
+static long run_barrier() {
+    long rounds = ops/threads > 0 ? ops/threads : 1;
+    pthread_t tids[threads];
+    arrived = 0;
+    generation = 0;
+    for (int i=0; i<threads; i++)
+        pthread_create(&tids[i], NULL, barrier_thread, (void*)(intptr_t)rounds);
+    for (int i=0; i<threads; i++)
+        pthread_join(tids[i], NULL);
+    if (generation != rounds) {
+        fprintf(stderr, "barrier: %ld of %ld rounds\n", generation, rounds);
+        exit(1);
+    }
+    return rounds;
+}
+
+// pool =========================
+
+static long submitted, taken, finished;
+static bool stopping;
+
+static void* pool_worker(void* arg) {
+    for (;;) {
+        tl_lock(&lock);
+        while (taken == submitted && !stopping)
+            wait_on(&not_empty);
+        if (taken == submitted) {
+            tl_unlock(&lock);
+            return NULL;
+        }
+        taken++;
+        tl_unlock(&lock);
+
+        tl_lock(&lock);
+        if (++finished == submitted)
+            signal_on(&done);
+        tl_unlock(&lock);
+    }
+}
+
+static long run_pool() {
+    pthread_t tids[threads];
+    submitted = taken = finished = 0;
+    stopping = false;
+    for (int i=0; i<threads; i++)
+        pthread_create(&tids[i], NULL, pool_worker, NULL);
+    // batches of one task per worker, like a parallel for
+    while (submitted < ops) {
+        tl_lock(&lock);
+        for (int i=0; i<threads && submitted < ops; i++) {
+            submitted++;
+            signal_on(&not_empty);
+        }
+        while (finished != submitted)
+            wait_on(&done);
+        tl_unlock(&lock);
+    }
+    tl_lock(&lock);
+    stopping = true;
+    broadcast_on(&not_empty);
+    tl_unlock(&lock);
+    for (int i=0; i<threads; i++)
+        pthread_join(tids[i], NULL);
+    return ops;
+}
+
+// measurement =========================
+
+// counts futex syscalls of this thread and the ones it starts, or -1
+static int open_futex_counter() {
+    const char *paths[] = {"/sys/kernel/tracing/events/syscalls/sys_enter_futex/id",
+                           "/sys/kernel/debug/tracing/events/syscalls/sys_enter_futex/id"};
+    long id = -1;
+    for (int i=0; i<2 && id < 0; i++) {
+        FILE *f = fopen(paths[i], "r");
+        if (f) {
+            if (fscanf(f, "%ld", &id) != 1)
+                id = -1;
+            fclose(f);
+        }
+    }
+    if (id < 0)
+        return -1;
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = id;
+    attr.inherit = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static int by_value(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run(const char *backend, const char *pattern, long (*fun)()) {
+    memset(&not_empty, 0, sizeof(not_empty));
+    memset(&not_full, 0, sizeof(not_full));
+    memset(&done, 0, sizeof(done));
+    num_samples = 0;
+
+    struct rusage before, after;
+    int futexes = open_futex_counter();
+    getrusage(RUSAGE_SELF, &before);
+    int64_t start = now_ns();
+    long n = fun();
+    int64_t elapsed = now_ns() - start;
+    getrusage(RUSAGE_SELF, &after);
+    int64_t calls = -1;
+    if (futexes >= 0) {
+        if (read(futexes, &calls, sizeof(calls)) != sizeof(calls))
+            calls = -1;
+        close(futexes);
+    }
+
+    int64_t num = num_samples < MAX_SAMPLES ? num_samples : MAX_SAMPLES;
+    double per_ns = tl_tsc_per_ns > 0 ? tl_tsc_per_ns : 1;
+    qsort(samples, num, sizeof(uint64_t), by_value);
+    printf("%s,%s,%s,%d,%ld,%.0f,", getenv("LIBTXLOCK_LOCK"), backend, pattern, threads, n,
+           n*1e9/elapsed);
+    if (num)
+        printf("%.0f,%.0f,%.0f,%.0f,%ld,", samples[num/2]/per_ns, samples[num*9/10]/per_ns,
+               samples[num*99/100]/per_ns, samples[num-1]/per_ns, (long)num_samples);
+    else
+        printf(",,,,0,");
+    if (calls >= 0)
+        printf("%.3f", (double)calls/n);
+    printf(",%.3f\n", (double)(after.ru_nvcsw - before.ru_nvcsw)/n);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    const char *locks = NULL, *backends = "pthread,pthread_tm,sem";
+    bool rtm = __builtin_cpu_supports("rtm");
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:b:t:n:q:")) != -1) {
+        switch (opt) {
+        case 'l': locks = optarg; break;
+        case 'b': backends = optarg; break;
+        case 't': threads = atoi(optarg); break;
+        case 'n': ops = atol(optarg); break;
+        case 'q': slots = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-l locks] [-b backends] [-t threads] [-n ops] "
+                            "[-q slots]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (threads < 2 || ops < 1 || slots < 1) {
+        fprintf(stderr, "need at least two threads, one op and one slot\n");
+        return 2;
+    }
+
+    if (getenv("BENCH_CONDVAR_CHILD")) {
+        tl_calibrate_tsc();
+        samples = malloc(MAX_SAMPLES*sizeof(uint64_t));
+        buffer = malloc(slots*sizeof(long));
+        if (!samples || !buffer) {
+            perror("malloc");
+            return 1;
+        }
+        const char *names[3] = {"pthread", "pthread_tm", "sem"};
+        for (int b=0; b<3; b++) {
+            if (!bench_listed(names[b], backends) || (b == 1 && !rtm))
+                continue;
+            USE_PTHREAD_COND_VARS = b < 2;
+            TM_COND_VARS = b == 1;
+            run(names[b], "queue", run_queue);
+            run(names[b], "barrier", run_barrier);
+            run(names[b], "pool", run_pool);
+        }
+        return 0;
+    }
+
+    if (bench_listed("pthread_tm", backends) && !rtm)
+        fprintf(stderr, "pthread_tm skipped, no RTM\n");
+    printf("lock,backend,pattern,threads,ops,ops_per_s,wake_p50_ns,wake_p90_ns,wake_p99_ns,"
+           "wake_max_ns,wakeups,futex_per_op,sleeps_per_op\n");
+    const char *names[BENCH_MAX_LOCKS];
+    int num_names = bench_lock_types(locks, names);
+    for (int i=0; i<num_names; i++)
+        bench_spawn(argv, "BENCH_CONDVAR_CHILD", names[i], "off", NULL);
+    return 0;
+}
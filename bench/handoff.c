@@ -0,0 +1,186 @@
+#define _GNU_SOURCE // for pthread_setaffinity_np()
+
+// Release-to-acquire latency of every lock type, for each pair of CPUs.
+//
+// Two threads pinned to CPUs a and b pass one lock back and forth. The
+// holder waits until the other thread is about to lock, holds on for `hold`
+// cycles so that it's really waiting, stamps the TSC and unlocks; the new
+// holder stamps it again as soon as tl_lock returns. Each type prints a
+// matrix of the median latency in ns, from the row's CPU to the column's.
+//
+// Like bench/locks, every lock type runs in a child process of its own. The
+// _tm types and tas_hle are left out on CPUs without RTM; with it, the
+// ping-pong mostly aborts them onto their fallback path.
+//
+// usage: bench/handoff [-l locks] [-c cpus] [-r rounds] [-w hold]
+// locks and cpus are comma separated lists, by default all of them
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "txlock.h"
+#include "txutil.h"
+#include "harness.h"
+
+#define MAX_CPUS 1024
+
+static txlock_t lock;
+static volatile uint64_t released_at;
+static volatile int waiting = -1; // the thread about to lock
+static volatile int64_t handoffs;
+static volatile int ready;
+
+static int rounds = 1000;
+static uint64_t hold = 1000;
+static uint64_t *samples[2]; // [i]: handoffs to thread i
+
+typedef struct {
+    int me;
+    int cpu;
+} player_t;
+
+static void* player(void* arg) {
+    player_t *p = arg;
+    int me = p->me, other = 1 - me;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(p->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    bool holding = me == 0;
+    if (holding) {
+        tl_lock(&lock);
+        ready = 1;
+    }
+    while (!ready)
+        cpu_relax();
+
+    int64_t total = 2*(int64_t)rounds;
+    int n = 0;
+    for (;;) {
+        if (handoffs >= total)
+            break;
+        if (holding) {
+            while (waiting != other)
+                cpu_relax();
+            uint64_t t = rdtsc();
+            while (rdtsc() - t < hold)
+                cpu_relax();
+            int64_t h = handoffs;
+            released_at = rdtsc();
+            tl_unlock(&lock);
+            holding = false;
+            while (handoffs == h)
+                cpu_relax();
+        } else {
+            waiting = me;
+            tl_lock(&lock);
+            uint64_t t = rdtsc();
+            waiting = -1;
+            samples[me][n++] = t - released_at;
+            holding = true;
+            handoffs++;
+        }
+    }
+    if (holding)
+        tl_unlock(&lock);
+    return NULL;
+}
+
+static int by_value(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// median ns of the handoffs from cpus[a] to cpus[b], and back
+static void play(int *cpus, int a, int b, double *from_a, double *from_b) {
+    pthread_t t[2];
+    player_t p[2] = {{0, cpus[a]}, {1, cpus[b]}};
+    handoffs = 0;
+    ready = 0;
+    waiting = -1;
+    pthread_create(&t[0], NULL, player, &p[0]);
+    pthread_create(&t[1], NULL, player, &p[1]);
+    pthread_join(t[0], NULL);
+    pthread_join(t[1], NULL);
+
+    double per_ns = tl_tsc_per_ns > 0 ? tl_tsc_per_ns : 1;
+    qsort(samples[1], rounds, sizeof(uint64_t), by_value);
+    qsort(samples[0], rounds, sizeof(uint64_t), by_value);
+    *from_a = samples[1][rounds/2]/per_ns;
+    *from_b = samples[0][rounds/2]/per_ns;
+}
+
+int main(int argc, char** argv) {
+    static int cpus[MAX_CPUS];
+    int num_cpus = 0;
+    const char *locks = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:c:r:w:")) != -1) {
+        switch (opt) {
+        case 'l': locks = optarg; break;
+        case 'c': num_cpus = bench_parse_list(optarg, cpus, MAX_CPUS); break;
+        case 'r': rounds = atoi(optarg); break;
+        case 'w': hold = atol(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-l locks] [-c cpus] [-r rounds] [-w hold]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (num_cpus == 0) {
+        cpu_set_t set;
+        sched_getaffinity(0, sizeof(set), &set);
+        for (int c=0; c<CPU_SETSIZE && num_cpus < MAX_CPUS; c++) {
+            if (CPU_ISSET(c, &set))
+                cpus[num_cpus++] = c;
+        }
+    }
+    if (num_cpus < 2 || rounds < 1) {
+        fprintf(stderr, "need at least two cpus and one round\n");
+        return 2;
+    }
+
+    if (getenv("BENCH_HANDOFF_CHILD")) {
+        tl_calibrate_tsc();
+        samples[0] = malloc(rounds*sizeof(uint64_t));
+        samples[1] = malloc(rounds*sizeof(uint64_t));
+        double *matrix = calloc(num_cpus*num_cpus, sizeof(double));
+        if (!samples[0] || !samples[1] || !matrix) {
+            perror("malloc");
+            return 1;
+        }
+        for (int a=0; a<num_cpus; a++)
+            for (int b=a+1; b<num_cpus; b++)
+                play(cpus, a, b, &matrix[a*num_cpus + b], &matrix[b*num_cpus + a]);
+
+        const char *name = getenv("LIBTXLOCK_LOCK");
+        printf("%s,from\\to", name);
+        for (int b=0; b<num_cpus; b++)
+            printf(",%d", cpus[b]);
+        printf("\n");
+        for (int a=0; a<num_cpus; a++) {
+            printf("%s,%d", name, cpus[a]);
+            for (int b=0; b<num_cpus; b++) {
+                if (a == b)
+                    printf(",");
+                else
+                    printf(",%.0f", matrix[a*num_cpus + b]);
+            }
+            printf("\n");
+        }
+        return 0;
+    }
+
+    const char *names[BENCH_MAX_LOCKS];
+    int num_names = bench_lock_types(locks, names);
+    for (int i=0; i<num_names; i++)
+        bench_spawn(argv, "BENCH_HANDOFF_CHILD", names[i], "off", NULL);
+    return 0;
+}
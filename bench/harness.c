@@ -0,0 +1,76 @@
+#define _GNU_SOURCE // for syscall() in txlock_internal.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "txlock.h"
+#include "txlock_internal.h" // for the lock type names
+#include "harness.h"
+
+int bench_parse_list(const char *arg, int *list, int max) {
+    int n = 0;
+    while (*arg && n < max) {
+        list[n++] = atoi(arg);
+        const char *comma = strchr(arg, ',');
+        if (!comma)
+            break;
+        arg = comma + 1;
+    }
+    return n;
+}
+
+bool bench_listed(const char *name, const char *list) {
+    size_t len = strlen(name);
+    for (const char *p = list; p; p = strchr(p, ',')) {
+        if (*p == ',')
+            p++;
+        if (strncmp(p, name, len) == 0 && (p[len] == ',' || p[len] == 0))
+            return true;
+    }
+    return false;
+}
+
+bool bench_is_htm(const char *name) {
+    for (int i=0; i<TL_NUM_LOCK_TYPES; i++)
+        if (strcmp(lock_types_counts[i].name, name) == 0)
+            return lock_types_counts[i].htm;
+    return false;
+}
+
+int bench_lock_types(const char *locks, const char **names) {
+    bool rtm = __builtin_cpu_supports("rtm");
+    int n = 0;
+    for (int i=0; i<TL_NUM_LOCK_TYPES && n < BENCH_MAX_LOCKS; i++) {
+        const char *name = lock_types_counts[i].name;
+        if (locks && !bench_listed(name, locks))
+            continue;
+        if (lock_types_counts[i].htm && !rtm) {
+            fprintf(stderr, "%s skipped, no RTM\n", name);
+            continue;
+        }
+        names[n++] = name;
+    }
+    return n;
+}
+
+void bench_spawn(char** argv, const char *child, const char *name, const char *stats,
+                 const char **env) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        setenv("LIBTXLOCK_LOCK", name, 1);
+        setenv("LIBTXLOCK_STATS", stats, 1);
+        for (int i=0; env && env[i]; i+=2)
+            setenv(env[i], env[i+1], 1);
+        setenv(child, "1", 1);
+        execv("/proc/self/exe", argv);
+        perror("execv");
+        _exit(1);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+        fprintf(stderr, "%s failed\n", name);
+}
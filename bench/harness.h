@@ -0,0 +1,35 @@
+#ifndef _BENCH_HARNESS_H_
+#define _BENCH_HARNESS_H_
+
+// What the benchmarks that sweep every lock type share (bench/harness.c).
+//
+// The lock type is fixed when the library loads, so such a benchmark runs
+// itself again for each type, as a child process that finds its marker
+// variable set.
+
+#include <stdbool.h>
+
+#define BENCH_MAX_LOCKS 64
+
+// parses a comma separated list of up to max numbers into list,
+// returns how many there were
+int bench_parse_list(const char *arg, int *list, int max);
+
+// whether name is in the comma separated list
+bool bench_listed(const char *name, const char *list);
+
+// whether the lock type speculates (the _tm types and tas_hle)
+bool bench_is_htm(const char *name);
+
+// The names of the lock types in the comma separated list locks, or of all
+// of them if it's NULL, into names. The speculating types are left out, with
+// a note on stderr, on CPUs without RTM. Returns how many there are.
+int bench_lock_types(const char *locks, const char **names);
+
+// Runs this program again with the same arguments and with LIBTXLOCK_LOCK
+// set to name, LIBTXLOCK_STATS to stats and the child marker to 1, plus the
+// name, value pairs in env (NULL terminated, or NULL), and waits for it.
+void bench_spawn(char** argv, const char *child, const char *name, const char *stats,
+                 const char **env);
+
+#endif
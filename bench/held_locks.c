@@ -0,0 +1,48 @@
+// Unlock cost as a function of how many locks the calling thread holds.
+//
+// Each round takes `held` locks and then releases them in acquisition order,
+// so the oldest lock is released first. Prints one CSV row per `held` with
+// the average cost of a single tl_unlock.
+//
+// usage: LIBTXLOCK_LOCK=mcs bench/held_locks [max_held] [rounds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "txlock.h"
+
+static int64_t now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000000L + t.tv_nsec;
+}
+
+int main(int argc, char** argv) {
+    int max_held = argc>1 ? atoi(argv[1]) : 1024;
+    int rounds = argc>2 ? atoi(argv[2]) : 1000;
+
+    txlock_t* locks = calloc(max_held, sizeof(txlock_t));
+    if (!locks) {
+        perror("calloc");
+        return 1;
+    }
+
+    printf("held,unlock_ns\n");
+    for (int held=1; held<=max_held; held*=2) {
+        int64_t total = 0;
+        for (int r=0; r<rounds; r++) {
+            for (int i=0; i<held; i++)
+                tl_lock(&locks[i]);
+            int64_t start = now_ns();
+            for (int i=0; i<held; i++)
+                tl_unlock(&locks[i]);
+            total += now_ns() - start;
+        }
+        printf("%d,%.1f\n", held, (double)total/((double)rounds*held));
+    }
+
+    free(locks);
+    return 0;
+}
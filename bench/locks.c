@@ -0,0 +1,196 @@
+// Throughput and HTM stats of every lock type.
+//
+// Threads repeatedly take one lock, do `cs` units of work and write
+// `footprint` cache lines of a shared array (at a random offset, so HTM
+// sections can be disjoint), then do `noncs` units of work outside. Each
+// point of the sweep runs for `ms` milliseconds and prints one CSV row with
+// the critical sections per second and what the library counted meanwhile.
+//
+// The lock type and the TK_* settings are fixed at load time, so each type
+// and, for the speculating types, each point of the -g grid runs in a child
+// process started with the matching LIBTXLOCK_* variables. Those types (the
+// _tm ones and tas_hle) are left out on CPUs without RTM.
+//
+// usage: bench/locks [-l locks] [-t threads] [-c cs] [-f footprint]
+//                    [-n noncs] [-g tries:min:max,...] [-d ms]
+// every option takes a comma separated list
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "txlock.h"
+#include "txutil.h"
+#include "harness.h"
+
+#define SHARED_LINES 4096
+#define MAX_LIST 64
+
+typedef struct {
+    volatile int64_t value;
+} __attribute__((aligned(CACHE_LINE_SIZE))) line_t;
+
+static line_t shared[SHARED_LINES];
+static txlock_t lock;
+static volatile int running = 0;  // 1 go, 2 stop
+
+static int cs, footprint, noncs;
+
+static int64_t now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000000L + t.tv_nsec;
+}
+
+// a dependent chain the compiler can't fold away
+static inline uint64_t work(uint64_t x, int units) {
+    for (int i=0; i<units; i++)
+        x = x*6364136223846793005ULL + 1442695040888963407ULL;
+    return x;
+}
+
+static void* worker(void* arg) {
+    uint64_t rnd = (uintptr_t)arg * 0x9e3779b97f4a7c15ULL + 1;
+    int64_t ops = 0;
+    while (running == 0)
+        ;
+    while (running == 1) {
+        rnd ^= rnd << 13;
+        rnd ^= rnd >> 7;
+        rnd ^= rnd << 17;
+        int first = rnd % (SHARED_LINES - footprint + 1);
+
+        tl_lock(&lock);
+        uint64_t x = work(rnd, cs);
+        for (int i=0; i<footprint; i++)
+            shared[first + i].value++;
+        tl_unlock(&lock);
+
+        rnd ^= work(x, noncs) & 1;
+        ops++;
+    }
+    return (void*)(intptr_t)ops;
+}
+
+static void run(int threads, int ms) {
+    pthread_t tids[threads];
+    int64_t before = 0, ops = 0;
+    for (int i=0; i<SHARED_LINES; i++)
+        before += shared[i].value;
+
+    running = 0;
+    for (int i=0; i<threads; i++)
+        pthread_create(&tids[i], NULL, worker, (void*)(intptr_t)(i + 1));
+    struct timespec t = {ms/1000, (ms%1000)*1000000L};
+    struct tl_stats s;
+    tl_stats_reset();
+    int64_t start = now_ns();
+    running = 1;
+    nanosleep(&t, NULL);
+    running = 2;
+    int64_t elapsed = now_ns() - start;
+    tl_stats_snapshot(&s);
+    for (int i=0; i<threads; i++) {
+        void* ret;
+        pthread_join(tids[i], &ret);
+        ops += (intptr_t)ret;
+    }
+
+    int64_t after = 0;
+    for (int i=0; i<SHARED_LINES; i++)
+        after += shared[i].value;
+    if (after - before != ops*footprint) {
+        fprintf(stderr, "%s: lost updates, %ld lines written, expected %ld\n",
+                getenv("LIBTXLOCK_LOCK"), after - before, ops*footprint);
+        exit(1);
+    }
+
+    const char *tries = getenv("LIBTXLOCK_NUM_TRIES");
+    const char *min = getenv("LIBTXLOCK_MIN_DISTANCE");
+    const char *max = getenv("LIBTXLOCK_MAX_DISTANCE");
+    printf("%s,%s,%s,%s,%d,%d,%d,%d,%.0f,%lld,%lld,%lld,%lld,%lld,%lld,%.4f\n",
+           getenv("LIBTXLOCK_LOCK"), tries ? tries : "", min ? min : "", max ? max : "",
+           threads, cs, footprint, noncs, ops*1e9/elapsed, s.locks, s.tries, s.commits,
+           s.conflicts, s.overflows, s.explicits, s.tries ? (double)s.commits/s.tries : 0);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    int threads[MAX_LIST], css[MAX_LIST], footprints[MAX_LIST], noncss[MAX_LIST];
+    int num_threads = 0, num_cs = 1, num_footprints = 2, num_noncs = 2;
+    css[0] = 64;
+    footprints[0] = 1; footprints[1] = 16;
+    noncss[0] = 0; noncss[1] = 256;
+    const char *locks = NULL;
+    const char *grid = "1:0:2,2:0:2,4:0:2,2:1:4";
+    int ms = 100;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:t:c:f:n:g:d:")) != -1) {
+        switch (opt) {
+        case 'l': locks = optarg; break;
+        case 't': num_threads = bench_parse_list(optarg, threads, MAX_LIST); break;
+        case 'c': num_cs = bench_parse_list(optarg, css, MAX_LIST); break;
+        case 'f': num_footprints = bench_parse_list(optarg, footprints, MAX_LIST); break;
+        case 'n': num_noncs = bench_parse_list(optarg, noncss, MAX_LIST); break;
+        case 'g': grid = optarg; break;
+        case 'd': ms = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-l locks] [-t threads] [-c cs] [-f footprint] "
+                            "[-n noncs] [-g tries:min:max,...] [-d ms]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (num_threads == 0) {
+        int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int t=1; num_threads < MAX_LIST; t*=2) {
+            threads[num_threads++] = t < cpus ? t : cpus;
+            if (t >= cpus)
+                break;
+        }
+    }
+
+    if (getenv("BENCH_LOCKS_CHILD")) {
+        for (int t=0; t<num_threads; t++)
+            for (int c=0; c<num_cs; c++)
+                for (int f=0; f<num_footprints; f++)
+                    for (int n=0; n<num_noncs; n++) {
+                        cs = css[c];
+                        footprint = footprints[f] < SHARED_LINES ? footprints[f] : SHARED_LINES;
+                        noncs = noncss[n];
+                        run(threads[t], ms);
+                    }
+        return 0;
+    }
+
+    const char *names[BENCH_MAX_LOCKS];
+    int num_names = bench_lock_types(locks, names);
+    printf("lock,num_tries,min_distance,max_distance,threads,cs,footprint,noncs,"
+           "ops_per_s,locks,tries,commits,conflicts,overflows,explicits,commit_ratio\n");
+    for (int i=0; i<num_names; i++) {
+        if (!bench_is_htm(names[i])) {
+            bench_spawn(argv, "BENCH_LOCKS_CHILD", names[i], "counts", NULL);
+            continue;
+        }
+        // the TK_* settings only matter when speculating
+        char point[64];
+        for (const char *g = grid; g && *g; g = strchr(g, ',') ? strchr(g, ',') + 1 : NULL) {
+            char tries[16], min[16], max[16];
+            size_t len = strcspn(g, ",");
+            snprintf(point, sizeof(point), "%.*s", (int)len, g);
+            if (sscanf(point, "%15[^:]:%15[^:]:%15s", tries, min, max) != 3) {
+                fprintf(stderr, "bad grid point %s, expected tries:min:max\n", point);
+                return 2;
+            }
+            const char *env[] = {"LIBTXLOCK_NUM_TRIES", tries, "LIBTXLOCK_MIN_DISTANCE", min,
+                                 "LIBTXLOCK_MAX_DISTANCE", max, NULL};
+            bench_spawn(argv, "BENCH_LOCKS_CHILD", names[i], "counts", env);
+        }
+    }
+    return 0;
+}
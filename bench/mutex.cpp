@@ -0,0 +1,73 @@
+// txlock::basic_mutex instantiations against std::mutex.
+//
+// Every thread increments a shared counter under std::lock_guard. Prints
+// one CSV row per mutex and thread count with the average time per critical
+// section, summed over all threads. The _tm mutexes only run on CPUs with
+// RTM.
+//
+// usage: bench/mutex [max_threads] [ops_per_thread]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "txlock.hpp"
+
+static int64_t now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000000L + t.tv_nsec;
+}
+
+template<class M>
+static void run(const char *name, int threads, long ops) {
+    M m;
+    volatile long counter = 0;
+
+    std::vector<std::thread> workers;
+    int64_t start = now_ns();
+    for (int t=0; t<threads; t++) {
+        workers.emplace_back([&] {
+            for (long i=0; i<ops; i++) {
+                std::lock_guard<M> guard(m);
+                counter = counter + 1;
+            }
+        });
+    }
+    for (auto &w : workers)
+        w.join();
+    int64_t elapsed = now_ns() - start;
+
+    if (counter != threads*ops) {
+        fprintf(stderr, "%s: counted %ld, expected %ld\n", name, (long)counter, threads*ops);
+        exit(1);
+    }
+    printf("%s,%d,%.1f\n", name, threads, (double)elapsed/(threads*ops));
+}
+
+int main(int argc, char** argv) {
+    int max_threads = argc>1 ? atoi(argv[1]) : 8;
+    long ops = argc>2 ? atol(argv[2]) : 1000000;
+    bool rtm = __builtin_cpu_supports("rtm");
+
+    printf("mutex,threads,cs_ns\n");
+    for (int threads=1; threads<=max_threads; threads*=2) {
+        run<std::mutex>("std::mutex", threads, ops);
+        run<txlock::tas_mutex>("tas", threads, ops);
+        run<txlock::tas_park_mutex>("tas_park", threads, ops);
+        run<txlock::ticket_mutex>("ticket", threads, ops);
+        run<txlock::ticket_park_mutex>("ticket_park", threads, ops);
+        run<txlock::mcs_mutex>("mcs", threads, ops);
+        run<txlock::mcs_park_mutex>("mcs_park", threads, ops);
+        if (rtm) {
+            run<txlock::tas_tm_mutex>("tas_tm", threads, ops);
+            run<txlock::ticket_tm_mutex>("ticket_tm", threads, ops);
+            run<txlock::mcs_tm_mutex>("mcs_tm", threads, ops);
+        }
+    }
+    return 0;
+}
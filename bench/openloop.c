@@ -0,0 +1,237 @@
+// Tail latency of every lock type under open-loop load.
+//
+// Closed-loop benchmarks issue the next request when the last one is done,
+// so a slow lock slows the load down with it and the queueing never shows.
+// Here threads issue requests on a fixed schedule, `rate` per second over
+// all of them, whether or not the earlier ones are done. Each request takes
+// the lock, does `cs` units of work and writes `footprint` cache lines.
+//
+// Latency is measured from when a request was due, not from when its
+// thread got around to it, which corrects for coordinated omission: a
+// request stuck behind a slow one is charged the time it spent waiting to
+// be issued. The service time, from tl_lock to tl_unlock returning, is
+// kept too; the gap between the two p99s is the queueing. An overloaded
+// point goes on issuing its backlog for up to another `ms`. Requests still
+// not issued by then count as unfinished and are recorded with the time
+// they have waited so far, so the tail is a lower bound instead of missing.
+//
+// Both are recorded into per-thread histograms, txhist.h's with 128
+// sub-buckets per power of two, off by at most 1/128 (0.8%), and the
+// percentiles are taken the same way as in the library's latency report.
+// Each lock type runs in a child process of its own and prints one CSV row
+// per rate; the _tm types and tas_hle are left out on CPUs without RTM.
+//
+// usage: bench/openloop [-l locks] [-t threads] [-r rates] [-c cs]
+//                       [-f footprint] [-d ms]
+// rates is a comma separated list of requests per second
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "txlock.h"
+#include "txutil.h"
+#include "harness.h"
+
+#define HIST_SUB_BITS 7 // 128 sub-buckets, at most 1/128 off
+#include "txhist.h"
+
+#define SHARED_LINES 4096
+#define MAX_LIST 64
+#define MAX_THREADS 1024
+
+#define SLEEP_NS 100000 // sleep instead of spinning until a request is due
+#define EARLY_NS 50000  // waking up this early
+
+// load =========================
+
+typedef struct {
+    volatile int64_t value;
+} __attribute__((aligned(CACHE_LINE_SIZE))) line_t;
+
+typedef struct {
+    int me;
+    hist_t latency; // from when the request was due
+    hist_t service; // from tl_lock to tl_unlock returning
+    int64_t last_done;
+    int64_t unfinished;
+} load_thread_t;
+
+static line_t shared[SHARED_LINES];
+static txlock_t lock;
+
+static int threads, cs, footprint;
+static double ns_per_request; // between requests over all threads
+static int64_t start, end, give_up;
+
+static int64_t now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000000L + t.tv_nsec;
+}
+
+static void wait_until(int64_t due) {
+    int64_t now;
+    while ((now = now_ns()) < due) {
+        if (due - now > SLEEP_NS) {
+            int64_t wake = due - EARLY_NS;
+            struct timespec t = {wake/1000000000L, wake%1000000000L};
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+        } else {
+            cpu_relax();
+        }
+    }
+}
+
+// a dependent chain the compiler can't fold away
+static inline uint64_t work(uint64_t x, int units) {
+    for (int i=0; i<units; i++)
+        x = x*6364136223846793005ULL + 1442695040888963407ULL;
+    return x;
+}
+
+static void* load_thread(void* arg) {
+    load_thread_t *me = arg;
+    uint64_t rnd = (me->me + 1) * 0x9e3779b97f4a7c15ULL;
+
+    // requests are spread evenly, thread i issues every threads-th one
+    for (int64_t k=me->me; ; k+=threads) {
+        int64_t due = start + (int64_t)(k*ns_per_request);
+        if (due >= end)
+            break;
+        int64_t now = now_ns();
+        if (now > give_up) {
+            for (; due < end; k+=threads, due = start + (int64_t)(k*ns_per_request)) {
+                hist_add(&me->latency, now - due);
+                me->unfinished++;
+            }
+            break;
+        }
+        wait_until(due);
+
+        rnd ^= rnd << 13;
+        rnd ^= rnd >> 7;
+        rnd ^= rnd << 17;
+        int first = rnd % (SHARED_LINES - footprint + 1);
+
+        int64_t began = now_ns();
+        tl_lock(&lock);
+        rnd ^= work(rnd, cs) & 1;
+        for (int i=0; i<footprint; i++)
+            shared[first + i].value++;
+        tl_unlock(&lock);
+        int64_t done = now_ns();
+
+        hist_add(&me->latency, done - due);
+        hist_add(&me->service, done - began);
+        me->last_done = done;
+    }
+    return NULL;
+}
+
+static void run(load_thread_t *load, int rate, int ms) {
+    pthread_t tids[threads];
+    ns_per_request = 1e9/rate;
+    for (int i=0; i<threads; i++) {
+        memset(&load[i], 0, sizeof(load_thread_t));
+        load[i].me = i;
+    }
+    // far enough out for every thread to be waiting when the first is due
+    start = now_ns() + 10000000L;
+    end = start + ms*1000000L;
+    give_up = end + ms*1000000L;
+    for (int i=0; i<threads; i++)
+        pthread_create(&tids[i], NULL, load_thread, &load[i]);
+    for (int i=0; i<threads; i++)
+        pthread_join(tids[i], NULL);
+
+    static hist_t latency, service;
+    memset(&latency, 0, sizeof(latency));
+    memset(&service, 0, sizeof(service));
+    int64_t last_done = start, unfinished = 0;
+    for (int i=0; i<threads; i++) {
+        hist_merge(&latency, &load[i].latency);
+        hist_merge(&service, &load[i].service);
+        if (load[i].last_done > last_done)
+            last_done = load[i].last_done;
+        unfinished += load[i].unfinished;
+    }
+
+    printf("%s,%d,%d,%d,%d,%.0f,%ld,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+           getenv("LIBTXLOCK_LOCK"), threads, cs, footprint, rate,
+           (latency.count - unfinished)*1e9/(last_done > start ? last_done - start : 1),
+           unfinished,
+           hist_percentile(&latency, 0.5), hist_percentile(&latency, 0.9),
+           hist_percentile(&latency, 0.99), hist_percentile(&latency, 0.999),
+           (uint64_t)latency.max, hist_percentile(&service, 0.5),
+           hist_percentile(&service, 0.99));
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    int rates[MAX_LIST];
+    int num_rates = 6;
+    for (int i=0; i<num_rates; i++)
+        rates[i] = 50000 << i;
+    const char *locks = NULL;
+    int ms = 200;
+    cs = 64;
+    footprint = 1;
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:t:r:c:f:d:")) != -1) {
+        switch (opt) {
+        case 'l': locks = optarg; break;
+        case 't': threads = atoi(optarg); break;
+        case 'r': num_rates = bench_parse_list(optarg, rates, MAX_LIST); break;
+        case 'c': cs = atoi(optarg); break;
+        case 'f': footprint = atoi(optarg); break;
+        case 'd': ms = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-l locks] [-t threads] [-r rates] [-c cs] "
+                            "[-f footprint] [-d ms]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (threads < 1 || threads > MAX_THREADS || ms < 1 || cs < 0) {
+        fprintf(stderr, "need 1 to %d threads, a run of at least 1 ms and cs >= 0\n",
+                MAX_THREADS);
+        return 2;
+    }
+    for (int i=0; i<num_rates; i++) {
+        if (rates[i] < 1) {
+            fprintf(stderr, "rates are at least 1 request per second\n");
+            return 2;
+        }
+    }
+    if (footprint < 0)
+        footprint = 0;
+    if (footprint > SHARED_LINES)
+        footprint = SHARED_LINES;
+
+    if (getenv("BENCH_OPENLOOP_CHILD")) {
+        load_thread_t *load = malloc(threads*sizeof(load_thread_t));
+        if (!load) {
+            perror("malloc");
+            return 1;
+        }
+        for (int r=0; r<num_rates; r++)
+            run(load, rates[r], ms);
+        free(load);
+        return 0;
+    }
+
+    printf("lock,threads,cs,footprint,offered_per_s,achieved_per_s,unfinished,p50_ns,p90_ns,"
+           "p99_ns,p999_ns,max_ns,service_p50_ns,service_p99_ns\n");
+    const char *names[BENCH_MAX_LOCKS];
+    int num_names = bench_lock_types(locks, names);
+    for (int i=0; i<num_names; i++)
+        bench_spawn(argv, "BENCH_OPENLOOP_CHILD", names[i], "off", NULL);
+    return 0;
+}
@@ -0,0 +1,649 @@
+// Lock-protected data structures under every lock type.
+//
+// Threads run a mix of reads and writes against one structure behind one
+// lock, the way most programs use a mutex:
+//
+// - hash: chained hash map; reads look a key up, writes insert or remove it
+// - tree: red-black tree, the same operations
+// - fifo: bounded ring; reads peek at the head, writes enqueue or dequeue
+// - pq: binary min-heap; reads peek at the minimum, writes push or pop
+//
+// Every entry carries a value of `value` bytes that reads copy out and
+// writes copy in, so with the key range it sets how much a critical section
+// touches: the _tm types win when that fits in the prefetched footprint and
+// lose to capacity aborts when it doesn't. Each point runs for `ms`
+// milliseconds and prints one CSV row with the operations per second and
+// what the library counted meanwhile, after checking the structure is
+// still intact.
+//
+// Like bench/locks, every lock type runs in a child process of its own and
+// the _tm types and tas_hle are left out on CPUs without RTM.
+//
+// usage: bench/structs [-l locks] [-s structs] [-t threads] [-k keys]
+//                      [-r read_pct] [-v value] [-d ms]
+// every option takes a comma separated list
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "txlock.h"
+#include "txutil.h"
+#include "harness.h"
+
+#define MAX_LIST 64
+#define MAX_VALUE 65536
+
+typedef struct node {
+    struct node *left, *right, *parent; // left is the chain in the hash map
+    long key;
+    int red;
+    char value[];
+} node_t;
+
+static txlock_t lock;
+static volatile int running = 0;  // 1 go, 2 stop
+
+static long keys;
+static int read_pct, value_size;
+
+// Entries are preallocated, each key has its own node, so nothing is
+// allocated inside a critical section.
+static char *nodes;
+static size_t node_size;
+static long size; // entries in the structure
+
+static inline node_t* node_of(long key) {
+    return (node_t*)(nodes + key*node_size);
+}
+
+static int64_t now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000000L + t.tv_nsec;
+}
+
+static inline uint64_t next_rnd(uint64_t *rnd) {
+    *rnd ^= *rnd << 13;
+    *rnd ^= *rnd >> 7;
+    *rnd ^= *rnd << 17;
+    return *rnd;
+}
+
+// hash =========================
+
+static node_t **buckets;
+static long num_buckets;
+
+static inline node_t** bucket_of(long key) {
+    return &buckets[(key*0x9e3779b97f4a7c15ULL >> 20) & (num_buckets - 1)];
+}
+
+static void hash_setup() {
+    num_buckets = 1;
+    while (num_buckets < keys)
+        num_buckets *= 2;
+    buckets = calloc(num_buckets, sizeof(node_t*));
+}
+
+// callers hold lock
+static void hash_read(long key, char *buf) {
+    for (node_t *n = *bucket_of(key); n; n = n->left) {
+        if (n->key == key) {
+            memcpy(buf, n->value, value_size);
+            return;
+        }
+    }
+}
+
+static void hash_write(long key, char *buf) {
+    node_t **b = bucket_of(key);
+    for (node_t **p = b; *p; p = &(*p)->left) {
+        if ((*p)->key == key) {
+            memcpy(buf, (*p)->value, value_size);
+            *p = (*p)->left;
+            size--;
+            return;
+        }
+    }
+    node_t *n = node_of(key);
+    n->key = key;
+    memcpy(n->value, buf, value_size);
+    n->left = *b;
+    *b = n;
+    size++;
+}
+
+static bool hash_check() {
+    long n = 0;
+    for (long b=0; b<num_buckets; b++) {
+        for (node_t *e = buckets[b]; e; e = e->left, n++) {
+            if (bucket_of(e->key) != &buckets[b])
+                return false;
+        }
+    }
+    return n == size;
+}
+
+static void hash_teardown() {
+    free(buckets);
+}
+
+// tree =========================
+
+static node_t *root;
+
+static void rotate_left(node_t *x) {
+    node_t *y = x->right;
+    x->right = y->left;
+    if (y->left)
+        y->left->parent = x;
+    y->parent = x->parent;
+    if (!x->parent)
+        root = y;
+    else if (x == x->parent->left)
+        x->parent->left = y;
+    else
+        x->parent->right = y;
+    y->left = x;
+    x->parent = y;
+}
+
+static void rotate_right(node_t *x) {
+    node_t *y = x->left;
+    x->left = y->right;
+    if (y->right)
+        y->right->parent = x;
+    y->parent = x->parent;
+    if (!x->parent)
+        root = y;
+    else if (x == x->parent->right)
+        x->parent->right = y;
+    else
+        x->parent->left = y;
+    y->right = x;
+    x->parent = y;
+}
+
+static inline bool is_red(node_t *n) {
+    return n && n->red;
+}
+
+static void insert_fixup(node_t *z) {
+    node_t *p;
+    while ((p = z->parent) && p->red) {
+        node_t *g = p->parent;
+        if (p == g->left) {
+            node_t *u = g->right;
+            if (is_red(u)) {
+                p->red = u->red = 0;
+                g->red = 1;
+                z = g;
+                continue;
+            }
+            if (z == p->right) {
+                rotate_left(p);
+                z = p;
+                p = z->parent;
+            }
+            p->red = 0;
+            g->red = 1;
+            rotate_right(g);
+        } else {
+            node_t *u = g->left;
+            if (is_red(u)) {
+                p->red = u->red = 0;
+                g->red = 1;
+                z = g;
+                continue;
+            }
+            if (z == p->left) {
+                rotate_right(p);
+                z = p;
+                p = z->parent;
+            }
+            p->red = 0;
+            g->red = 1;
+            rotate_left(g);
+        }
+    }
+    root->red = 0;
+}
+
+// puts v where u was, u's subtree is the caller's
+static void transplant(node_t *u, node_t *v) {
+    if (!u->parent)
+        root = v;
+    else if (u == u->parent->left)
+        u->parent->left = v;
+    else
+        u->parent->right = v;
+    if (v)
+        v->parent = u->parent;
+}
+
+// x took the place of a black node, and may be NULL, hence its parent
+static void erase_fixup(node_t *x, node_t *xp) {
+    while (x != root && !is_red(x)) {
+        if (x == xp->left) {
+            node_t *w = xp->right;
+            if (w->red) {
+                w->red = 0;
+                xp->red = 1;
+                rotate_left(xp);
+                w = xp->right;
+            }
+            if (!is_red(w->left) && !is_red(w->right)) {
+                w->red = 1;
+                x = xp;
+                xp = x->parent;
+                continue;
+            }
+            if (!is_red(w->right)) {
+                w->left->red = 0;
+                w->red = 1;
+                rotate_right(w);
+                w = xp->right;
+            }
+            w->red = xp->red;
+            xp->red = 0;
+            w->right->red = 0;
+            rotate_left(xp);
+        } else {
+            node_t *w = xp->left;
+            if (w->red) {
+                w->red = 0;
+                xp->red = 1;
+                rotate_right(xp);
+                w = xp->left;
+            }
+            if (!is_red(w->left) && !is_red(w->right)) {
+                w->red = 1;
+                x = xp;
+                xp = x->parent;
+                continue;
+            }
+            if (!is_red(w->left)) {
+                w->right->red = 0;
+                w->red = 1;
+                rotate_left(w);
+                w = xp->left;
+            }
+            w->red = xp->red;
+            xp->red = 0;
+            w->left->red = 0;
+            rotate_right(xp);
+        }
+        x = root;
+    }
+    if (x)
+        x->red = 0;
+}
+
+static void erase(node_t *z) {
+    node_t *x, *xp;
+    bool removed_red = z->red;
+    if (!z->left) {
+        x = z->right;
+        xp = z->parent;
+        transplant(z, x);
+    } else if (!z->right) {
+        x = z->left;
+        xp = z->parent;
+        transplant(z, x);
+    } else {
+        node_t *y = z->right;
+        while (y->left)
+            y = y->left;
+        removed_red = y->red;
+        x = y->right;
+        if (y->parent == z) {
+            xp = y;
+        } else {
+            xp = y->parent;
+            transplant(y, x);
+            y->right = z->right;
+            y->right->parent = y;
+        }
+        transplant(z, y);
+        y->left = z->left;
+        y->left->parent = y;
+        y->red = z->red;
+    }
+    if (!removed_red)
+        erase_fixup(x, xp);
+}
+
+static void tree_setup() {
+    root = NULL;
+}
+
+static void tree_read(long key, char *buf) {
+    node_t *n = root;
+    while (n && n->key != key)
+        n = key < n->key ? n->left : n->right;
+    if (n)
+        memcpy(buf, n->value, value_size);
+}
+
+static void tree_write(long key, char *buf) {
+    node_t *p = NULL, **link = &root;
+    while (*link) {
+        p = *link;
+        if (p->key == key) {
+            memcpy(buf, p->value, value_size);
+            erase(p);
+            size--;
+            return;
+        }
+        link = key < p->key ? &p->left : &p->right;
+    }
+    node_t *n = node_of(key);
+    n->key = key;
+    n->left = n->right = NULL;
+    n->parent = p;
+    n->red = 1;
+    memcpy(n->value, buf, value_size);
+    *link = n;
+    insert_fixup(n);
+    size++;
+}
+
+// black height, or -1 when the subtree is broken
+static long check_subtree(node_t *n, long lo, long hi, long *count) {
+    if (!n)
+        return 1;
+    (*count)++;
+    if (n->key < lo || n->key > hi)
+        return -1;
+    if (n->red && (is_red(n->left) || is_red(n->right)))
+        return -1;
+    if ((n->left && n->left->parent != n) || (n->right && n->right->parent != n))
+        return -1;
+    long l = check_subtree(n->left, lo, n->key - 1, count);
+    long r = check_subtree(n->right, n->key + 1, hi, count);
+    if (l < 0 || l != r)
+        return -1;
+    return l + !n->red;
+}
+
+static bool tree_check() {
+    long count = 0;
+    if (is_red(root) || (root && root->parent))
+        return false;
+    return check_subtree(root, 0, keys - 1, &count) > 0 && count == size;
+}
+
+static void tree_teardown() {
+}
+
+// fifo =========================
+
+// entries are nodes laid out in ring order, only key and value are used
+static long fifo_head;
+
+static void fifo_setup() {
+    fifo_head = 0;
+}
+
+static void fifo_read(long key, char *buf) {
+    if (size)
+        memcpy(buf, node_of(fifo_head)->value, value_size);
+}
+
+// enqueue or dequeue by the key's low bit, the other one when full or empty
+static void fifo_write(long key, char *buf) {
+    if (size == keys || (size && (key & 1))) {
+        memcpy(buf, node_of(fifo_head)->value, value_size);
+        fifo_head = fifo_head + 1 == keys ? 0 : fifo_head + 1;
+        size--;
+    } else {
+        long tail = fifo_head + size;
+        node_t *n = node_of(tail >= keys ? tail - keys : tail);
+        n->key = key;
+        memcpy(n->value, buf, value_size);
+        size++;
+    }
+}
+
+static bool fifo_check() {
+    return size >= 0 && size <= keys && fifo_head >= 0 && fifo_head < keys;
+}
+
+static void fifo_teardown() {
+}
+
+// pq =========================
+
+// a binary heap of nodes, moved by swapping keys and values through a
+// spare node past the end
+static inline void heap_copy(node_t *to, node_t *from) {
+    to->key = from->key;
+    memcpy(to->value, from->value, value_size);
+}
+
+static void pq_setup() {
+}
+
+static void pq_read(long key, char *buf) {
+    if (size)
+        memcpy(buf, node_of(0)->value, value_size);
+}
+
+// push or pop by the key's low bit, the other one when full or empty
+static void pq_write(long key, char *buf) {
+    node_t *spare = node_of(keys);
+    if (size == keys || (size && (key & 1))) {
+        memcpy(buf, node_of(0)->value, value_size);
+        heap_copy(spare, node_of(--size));
+        long i = 0;
+        for (;;) {
+            long c = 2*i + 1;
+            if (c >= size)
+                break;
+            if (c + 1 < size && node_of(c + 1)->key < node_of(c)->key)
+                c++;
+            if (node_of(c)->key >= spare->key)
+                break;
+            heap_copy(node_of(i), node_of(c));
+            i = c;
+        }
+        if (size)
+            heap_copy(node_of(i), spare);
+    } else {
+        spare->key = key;
+        memcpy(spare->value, buf, value_size);
+        long i = size++;
+        while (i > 0 && node_of((i - 1)/2)->key > spare->key) {
+            heap_copy(node_of(i), node_of((i - 1)/2));
+            i = (i - 1)/2;
+        }
+        heap_copy(node_of(i), spare);
+    }
+}
+
+static bool pq_check() {
+    for (long i=1; i<size; i++) {
+        if (node_of((i - 1)/2)->key > node_of(i)->key)
+            return false;
+    }
+    return size >= 0 && size <= keys;
+}
+
+static void pq_teardown() {
+}
+
+// workloads =========================
+
+typedef struct {
+    const char *name;
+    void (*setup)();
+    void (*read)(long key, char *buf);
+    void (*write)(long key, char *buf);
+    bool (*check)();
+    void (*teardown)();
+} workload_t;
+
+static const workload_t workloads[] = {
+    {"hash", hash_setup, hash_read, hash_write, hash_check, hash_teardown},
+    {"tree", tree_setup, tree_read, tree_write, tree_check, tree_teardown},
+    {"fifo", fifo_setup, fifo_read, fifo_write, fifo_check, fifo_teardown},
+    {"pq", pq_setup, pq_read, pq_write, pq_check, pq_teardown},
+};
+#define NUM_WORKLOADS (int)(sizeof(workloads)/sizeof(workloads[0]))
+
+static const workload_t *workload;
+
+static void* worker(void* arg) {
+    uint64_t rnd = (uintptr_t)arg * 0x9e3779b97f4a7c15ULL + 1;
+    char buf[value_size];
+    memset(buf, (int)(uintptr_t)arg, value_size);
+    int64_t ops = 0;
+    while (running == 0)
+        ;
+    while (running == 1) {
+        uint64_t r = next_rnd(&rnd);
+        long key = (r >> 8) % keys;
+        bool read = (int)(r % 100) < read_pct;
+
+        tl_lock(&lock);
+        if (read)
+            workload->read(key, buf);
+        else
+            workload->write(key, buf);
+        tl_unlock(&lock);
+        ops++;
+    }
+    return (void*)(intptr_t)ops;
+}
+
+static void run(int threads, int ms) {
+    pthread_t tids[threads];
+    int64_t ops = 0;
+
+    // the heap needs a spare entry past the end
+    node_size = (sizeof(node_t) + value_size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+    nodes = calloc(keys + 1, node_size);
+    if (!nodes) {
+        perror("calloc");
+        exit(1);
+    }
+    size = 0;
+    workload->setup();
+    // half full with the even keys, which all insert or push, so that
+    // writes go both ways from then on
+    char *fill = calloc(1, value_size);
+    for (long k=0; k<keys; k+=2)
+        workload->write(k, fill);
+    free(fill);
+
+    running = 0;
+    for (int i=0; i<threads; i++)
+        pthread_create(&tids[i], NULL, worker, (void*)(intptr_t)(i + 1));
+    struct timespec t = {ms/1000, (ms%1000)*1000000L};
+    struct tl_stats s;
+    tl_stats_reset();
+    int64_t start = now_ns();
+    running = 1;
+    nanosleep(&t, NULL);
+    running = 2;
+    int64_t elapsed = now_ns() - start;
+    tl_stats_snapshot(&s);
+    for (int i=0; i<threads; i++) {
+        void* ret;
+        pthread_join(tids[i], &ret);
+        ops += (intptr_t)ret;
+    }
+
+    if (!workload->check()) {
+        fprintf(stderr, "%s: %s is broken after %ld operations\n",
+                getenv("LIBTXLOCK_LOCK"), workload->name, ops);
+        exit(1);
+    }
+    workload->teardown();
+    free(nodes);
+
+    printf("%s,%s,%d,%ld,%d,%d,%.0f,%lld,%lld,%lld,%lld,%lld,%lld,%.4f\n",
+           getenv("LIBTXLOCK_LOCK"), workload->name, threads, keys, read_pct, value_size,
+           ops*1e9/elapsed, s.locks, s.tries, s.commits, s.conflicts, s.overflows,
+           s.explicits, s.tries ? (double)s.commits/s.tries : 0);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    int threads[MAX_LIST], keyss[MAX_LIST], read_pcts[MAX_LIST], values[MAX_LIST];
+    int num_threads = 0, num_keys = 2, num_reads = 2, num_values = 2;
+    keyss[0] = 1024; keyss[1] = 65536;
+    read_pcts[0] = 90; read_pcts[1] = 50;
+    values[0] = 16; values[1] = 512;
+    const char *locks = NULL, *structs = NULL;
+    int ms = 100;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:s:t:k:r:v:d:")) != -1) {
+        switch (opt) {
+        case 'l': locks = optarg; break;
+        case 's': structs = optarg; break;
+        case 't': num_threads = bench_parse_list(optarg, threads, MAX_LIST); break;
+        case 'k': num_keys = bench_parse_list(optarg, keyss, MAX_LIST); break;
+        case 'r': num_reads = bench_parse_list(optarg, read_pcts, MAX_LIST); break;
+        case 'v': num_values = bench_parse_list(optarg, values, MAX_LIST); break;
+        case 'd': ms = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-l locks] [-s structs] [-t threads] [-k keys] "
+                            "[-r read_pct] [-v value] [-d ms]\n", argv[0]);
+            return 2;
+        }
+    }
+    for (int i=0; i<num_keys; i++) {
+        if (keyss[i] < 2) {
+            fprintf(stderr, "need at least two keys\n");
+            return 2;
+        }
+    }
+    for (int i=0; i<num_values; i++) {
+        if (values[i] < 1 || values[i] > MAX_VALUE) {
+            fprintf(stderr, "values are 1 to %d bytes\n", MAX_VALUE);
+            return 2;
+        }
+    }
+    if (num_threads == 0) {
+        int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int t=1; num_threads < MAX_LIST; t*=2) {
+            threads[num_threads++] = t < cpus ? t : cpus;
+            if (t >= cpus)
+                break;
+        }
+    }
+
+    if (getenv("BENCH_STRUCTS_CHILD")) {
+        for (int w=0; w<NUM_WORKLOADS; w++) {
+            if (structs && !bench_listed(workloads[w].name, structs))
+                continue;
+            workload = &workloads[w];
+            for (int t=0; t<num_threads; t++)
+                for (int k=0; k<num_keys; k++)
+                    for (int r=0; r<num_reads; r++)
+                        for (int v=0; v<num_values; v++) {
+                            keys = keyss[k];
+                            read_pct = read_pcts[r];
+                            value_size = values[v];
+                            run(threads[t], ms);
+                        }
+        }
+        return 0;
+    }
+
+    printf("lock,struct,threads,keys,read_pct,value,ops_per_s,locks,tries,commits,"
+           "conflicts,overflows,explicits,commit_ratio\n");
+    const char *names[BENCH_MAX_LOCKS];
+    int num_names = bench_lock_types(locks, names);
+    for (int i=0; i<num_names; i++)
+        bench_spawn(argv, "BENCH_STRUCTS_CHILD", names[i], "counts", NULL);
+    return 0;
+}
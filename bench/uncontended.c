@@ -0,0 +1,59 @@
+// Uncontended lock+unlock latency of a single thread.
+//
+// "direct" calls tl_lock/tl_unlock, which are bound to the lock type's
+// methods on load. "indirect" replicates how every call was dispatched
+// before: a call into a wrapper, which calls the method through a function
+// pointer. Prints one CSV row per path with the average cost of a
+// lock+unlock pair.
+//
+// usage: LIBTXLOCK_LOCK=tas bench/uncontended [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "txlock.h"
+
+static int64_t now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000000L + t.tv_nsec;
+}
+
+// the old tl_lock and tl_unlock, volatile so the compiler can't see
+// through the pointers. Both paths take the same PLT jump to the method.
+static int (*volatile lock_fun)(txlock_t *) = tl_lock;
+static int (*volatile unlock_fun)(txlock_t *) = tl_unlock;
+
+__attribute__((noinline)) static int old_tl_lock(txlock_t *l) { return lock_fun(l); }
+__attribute__((noinline)) static int old_tl_unlock(txlock_t *l) { return unlock_fun(l); }
+
+static txlock_t lock;
+
+int main(int argc, char** argv) {
+    long iterations = argc>1 ? atol(argv[1]) : 10000000;
+
+    printf("path,pair_ns\n");
+    for (int round=0; round<2; round++) { // first round warms up
+        int64_t start = now_ns();
+        for (long i=0; i<iterations; i++) {
+            tl_lock(&lock);
+            tl_unlock(&lock);
+        }
+        int64_t direct = now_ns() - start;
+
+        start = now_ns();
+        for (long i=0; i<iterations; i++) {
+            old_tl_lock(&lock);
+            old_tl_unlock(&lock);
+        }
+        int64_t indirect = now_ns() - start;
+
+        if (round) {
+            printf("direct,%.2f\n", (double)direct/iterations);
+            printf("indirect,%.2f\n", (double)indirect/iterations);
+        }
+    }
+    return 0;
+}
@@ -47,36 +47,16 @@
 
 // from atomic.h
 
-# define atomic_exchange_and_add(mem, value) \
-  ({ __typeof (*(mem)) __oldval;					      \
-     __typeof (mem) __memp = (mem);					      \
-     __typeof (*(mem)) __value = (value);				      \
-									      \
-     do									      \
-       __oldval = (*__memp);						      \
-     while (__builtin_expect (__sync_bool_compare_and_swap (__memp,   \
-								    __oldval  \
-								    + __value,\
-								    __oldval),\
-			      0));					      \
-									      \
-     __oldval; })
+// __sync_bool_compare_and_swap takes (mem, old, new) and returns true on
+// success, the opposite of glibc's atomic_compare_and_exchange_bool_acq,
+// so use the fetch-and-op builtins directly
 
+# define atomic_exchange_and_add(mem, value) \
+  __sync_fetch_and_add ((mem), (value))
 
-     
 # define atomic_bit_test_set(mem, bit) \
-  ({ __typeof (*(mem)) __atg14_old;					      \
-     __typeof (mem) __atg14_memp = (mem);				      \
-     __typeof (*(mem)) __atg14_mask = ((__typeof (*(mem))) 1 << (bit));	      \
-									      \
-     do									      \
-       __atg14_old = (*__atg14_memp);					      \
-     while (__builtin_expect						      \
-	    (__sync_bool_compare_and_swap (__atg14_memp,	      \
-						   __atg14_old | __atg14_mask,\
-						   __atg14_old), 0));	      \
-									      \
-     __atg14_old & __atg14_mask; })
+  ({ __typeof (*(mem)) __atg14_mask = ((__typeof (*(mem))) 1 << (bit));	      \
+     __sync_fetch_and_or ((mem), __atg14_mask) & __atg14_mask; })
      
      
 # define atomic_add_zero(mem, value)					      \
@@ -343,7 +323,7 @@ __generic_mutex_lock (int *mutex, int private)
       /* We have to wait now. First make sure the futex value we are
 	 monitoring is truly negative (i.e. locked). */
       v = *mutex;
-      if (v >= 0)
+      if ((int) v >= 0)
 	continue;
 
       lll_futex_wait (mutex, v,
@@ -804,11 +784,9 @@ __pthread_cond_signal (cond)
       ++cond->__data.__futex;
 
       /* Wake one.  */
-      if (! __builtin_expect (lll_futex_wake_unlock (&cond->__data.__futex, 1,
-						     1, &cond->__data.__lock,
-						     pshared), 0))
-	return 0;
-
+      // skip the FUTEX_WAKE_OP unlock: it clears __lock the way lll locks
+      // do, which loses the waiter count of the bit 31 lock above and
+      // never wakes its waiters
       lll_futex_wake (&cond->__data.__futex, 1, pshared);
     }
 
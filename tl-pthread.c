@@ -1,38 +1,94 @@
-#include "txlock.h"
+#define _GNU_SOURCE // for syscall() in txlock_internal.h and pthread_rwlock_clock*lock()
+
 #include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "txlock.h"
+#include "txlock_internal.h"
 
 // internal handlers, should never be called inside a user app
 int _tl_pthread_create(void *thread, const void *attr, void *(*start_routine) (void *), void *arg);
 
-int pthread_mutex_lock(void *mutex) {
-    return tl_lock(mutex);
+// Plain wrappers: IFUNCs here would be resolved while other -z now objects
+// (libgcc_s, or everything under LD_BIND_NOW) are relocated, possibly before
+// this library is. With profiling or call-site policies on, pass on who's
+// locking.
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+    if (tl_sited)
+        return tl_lock_at((txlock_t*)mutex, __builtin_return_address(0));
+    return tl_lock((txlock_t*)mutex);
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+    if (tl_sited)
+        return tl_trylock_at((txlock_t*)mutex, __builtin_return_address(0));
+    return tl_trylock((txlock_t*)mutex);
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex) {
+    return tl_unlock((txlock_t*)mutex);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock) {
+    return tl_rdlock((txrwlock_t*)rwlock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock) {
+    return tl_wrlock((txrwlock_t*)rwlock);
 }
 
-int pthread_mutex_trylock(void *mutex) {
-    return tl_trylock(mutex);
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock) {
+    return tl_tryrdlock((txrwlock_t*)rwlock);
 }
 
-int pthread_mutex_unlock(void *mutex) {
-    return tl_unlock(mutex);
+int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock) {
+    return tl_trywrlock((txrwlock_t*)rwlock);
 }
 
-int pthread_cond_broadcast(void *cond) {
+int pthread_rwlock_unlock(pthread_rwlock_t *rwlock) {
+    return tl_rwunlock((txrwlock_t*)rwlock);
+}
+
+// std::shared_timed_mutex locks with these, they have to agree with the
+// interposed rwlock on what's in the lock
+int pthread_rwlock_timedrdlock(pthread_rwlock_t *rwlock, const struct timespec *abs_timeout) {
+    return tl_timedrdlock((txrwlock_t*)rwlock, CLOCK_REALTIME, abs_timeout);
+}
+
+int pthread_rwlock_timedwrlock(pthread_rwlock_t *rwlock, const struct timespec *abs_timeout) {
+    return tl_timedwrlock((txrwlock_t*)rwlock, CLOCK_REALTIME, abs_timeout);
+}
+
+int pthread_rwlock_clockrdlock(pthread_rwlock_t *rwlock, clockid_t clock,
+                               const struct timespec *abs_timeout) {
+    return tl_timedrdlock((txrwlock_t*)rwlock, clock, abs_timeout);
+}
+
+int pthread_rwlock_clockwrlock(pthread_rwlock_t *rwlock, clockid_t clock,
+                               const struct timespec *abs_timeout) {
+    return tl_timedwrlock((txrwlock_t*)rwlock, clock, abs_timeout);
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond) {
     return tc_broadcast((txcond_t*)cond);
 }
 
 
-int pthread_cond_signal(void *cond) {
-    return tc_signal(cond);
+int pthread_cond_signal(pthread_cond_t *cond) {
+    return tc_signal((txcond_t*)cond);
 }
 
-int pthread_cond_timedwait(void *cond, void *mutex, const struct timespec *timeout) {
-    return tc_timedwait(cond, mutex, timeout);
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                           const struct timespec *timeout) {
+    return tc_timedwait((txcond_t*)cond, (txlock_t*)mutex, timeout);
 }
 
-int pthread_cond_wait(void *cond, void *mutex) {
-    return tc_wait(cond, mutex);
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+    return tc_wait((txcond_t*)cond, (txlock_t*)mutex);
 }
 
-int pthread_create(void *thread, const void *attr, void *(*start_routine) (void *), void *arg) {
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                   void *(*start_routine) (void *), void *arg) {
     return _tl_pthread_create(thread, attr, start_routine, arg);
-}
\ No newline at end of file
+}
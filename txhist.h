@@ -0,0 +1,72 @@
+#ifndef TXHIST_H
+#define TXHIST_H
+
+// Log-linear latency histograms, like HdrHistogram: exact below
+// 2*HIST_SUB, then HIST_SUB buckets per power of two, so a value read back
+// is at most 1/HIST_SUB too high. txprofile.c keeps the default 32, off by
+// at most 1/32 (3.1%); define HIST_SUB_BITS before including this for finer
+// ones. Values are in whatever unit the caller adds.
+
+#include <stdint.h>
+
+#ifndef HIST_SUB_BITS
+#define HIST_SUB_BITS 5
+#endif
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 48 // everything longer lands in the last bucket
+#define HIST_BUCKETS  (2*HIST_SUB + (HIST_MAX_BITS - HIST_SUB_BITS - 1)*HIST_SUB)
+
+typedef struct {
+    int64_t count;
+    int64_t max;
+    int64_t buckets[HIST_BUCKETS];
+} hist_t;
+
+static inline int hist_bucket(uint64_t v) {
+    if (v < 2*HIST_SUB)
+        return v;
+    int m = 63 - __builtin_clzll(v);
+    if (m >= HIST_MAX_BITS)
+        return HIST_BUCKETS - 1;
+    return 2*HIST_SUB + (m - HIST_SUB_BITS - 1)*HIST_SUB + (v >> (m - HIST_SUB_BITS)) - HIST_SUB;
+}
+
+// the highest value of bucket i
+static inline uint64_t hist_value(int i) {
+    if (i < 2*HIST_SUB)
+        return i;
+    int m = (i - 2*HIST_SUB)/HIST_SUB + HIST_SUB_BITS + 1;
+    uint64_t sub = (i - 2*HIST_SUB)%HIST_SUB + HIST_SUB;
+    return ((sub + 1) << (m - HIST_SUB_BITS)) - 1;
+}
+
+static inline void hist_add(hist_t *h, uint64_t v) {
+    h->count++;
+    h->buckets[hist_bucket(v)]++;
+    if ((int64_t)v > h->max)
+        h->max = v;
+}
+
+static inline void hist_merge(hist_t *into, const hist_t *h) {
+    into->count += h->count;
+    if (h->max > into->max)
+        into->max = h->max;
+    for (int i=0; i<HIST_BUCKETS; i++)
+        into->buckets[i] += h->buckets[i];
+}
+
+// the bucket holding the ceil(q*count)-th smallest value, capped at the max
+static inline uint64_t hist_percentile(const hist_t *h, double q) {
+    int64_t target = (int64_t)(q * h->count + 0.999999);
+    int64_t seen = 0;
+    for (int i=0; i<HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= target && seen > 0) {
+            uint64_t v = hist_value(i);
+            return v < (uint64_t)h->max ? v : (uint64_t)h->max;
+        }
+    }
+    return h->max;
+}
+
+#endif
@@ -0,0 +1,162 @@
+// Live view of the lock stats of a process running with LIBTXLOCK_SHM=1.
+//
+// Maps its /dev/shm/txlock.<pid> segment read-only and prints, every
+// interval, the per-thread and total rates of the tm_stats_t counters. The
+// total includes the threads that exited in the meantime.
+// Stops when the process exits or after `iterations` screens.
+//
+// usage: txlock-top <pid> [interval_s] [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "txutil.h"
+
+static double now_s() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+// rate with a k/M/G suffix, in a 7 character column
+static void print_rate(double r) {
+    const char *unit = " kMGT";
+    while (r >= 9999.5 && unit[1]) {
+        r /= 1000;
+        unit++;
+    }
+    printf(" %6.0f%c", r, *unit);
+}
+
+static void print_row(const char *who, const tm_stats_t *now, const tm_stats_t *then, double dt) {
+    printf("%-8s", who);
+    print_rate((now->locks - then->locks)/dt);
+    print_rate((now->tries - then->tries)/dt);
+    print_rate((now->commits - then->commits)/dt);
+    print_rate((now->conflicts - then->conflicts)/dt);
+    print_rate((now->overflows - then->overflows)/dt);
+    print_rate((now->explicits - then->explicits)/dt);
+    print_rate((now->cycles - then->cycles)/dt);
+    print_rate((now->tm_cycles - then->tm_cycles)/dt);
+    printf("\n");
+}
+
+static void add_stats(tm_stats_t *sum, const tm_stats_t *s) {
+    sum->cycles += s->cycles;
+    sum->tm_cycles += s->tm_cycles;
+    sum->locks += s->locks;
+    sum->tries += s->tries;
+    sum->commits += s->commits;
+    sum->overflows += s->overflows;
+    sum->conflicts += s->conflicts;
+    sum->explicits += s->explicits;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <pid> [interval_s] [iterations]\n", argv[0]);
+        return 2;
+    }
+    int pid = atoi(argv[1]);
+    double interval = argc>2 ? atof(argv[2]) : 1.0;
+    long iterations = argc>3 ? atol(argv[3]) : -1;
+
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/shm/txlock.%d", pid);
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        return 1;
+    }
+    const tl_shm_header_t *hdr = MAP_FAILED;
+    if ((size_t)st.st_size >= sizeof(tl_shm_header_t))
+        hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED || hdr->magic != TL_SHM_MAGIC || hdr->version != TL_SHM_VERSION) {
+        fprintf(stderr, "%s: not a txlock stats segment\n", path);
+        return 1;
+    }
+    int slots = hdr->num_slots;
+    if (sizeof(tl_shm_header_t) + slots*sizeof(tm_stats_t) > (size_t)st.st_size) {
+        fprintf(stderr, "%s: truncated\n", path);
+        return 1;
+    }
+    const tm_stats_t *live = (const tm_stats_t*)(hdr + 1);
+
+    tm_stats_t *prev = calloc(slots, sizeof(tm_stats_t));
+    tm_stats_t *curr = calloc(slots, sizeof(tm_stats_t));
+    if (!prev || !curr) {
+        perror("calloc");
+        return 1;
+    }
+    int n = hdr->used_slots < slots ? hdr->used_slots : slots;
+    memcpy(prev, live, n*sizeof(tm_stats_t));
+    tm_stats_t prev_exited = hdr->exited, curr_exited;
+    double then = now_s();
+    bool tty = isatty(STDOUT_FILENO);
+
+    for (long it=0; iterations<0 || it<iterations; it++) {
+        struct timespec t = {(time_t)interval, (long)((interval - (time_t)interval)*1e9)};
+        nanosleep(&t, NULL);
+        bool alive = kill(pid, 0) == 0 || errno != ESRCH;
+
+        // a slot is zero until a thread takes it, and again once it's gone,
+        // so new threads start from zero in prev
+        n = hdr->used_slots < slots ? hdr->used_slots : slots;
+        memcpy(curr, live, n*sizeof(tm_stats_t));
+        curr_exited = hdr->exited;
+        double now = now_s(), dt = now - then;
+
+        if (tty)
+            printf("\033[H\033[2J");
+        int alive_threads = 0;
+        for (int i=0; i<n; i++)
+            alive_threads += curr[i].tid != 0;
+        printf("pid %d, lock %s, %d threads%s, %d exited, per second over %.1fs\n",
+               pid, hdr->lock_name, alive_threads,
+               hdr->used_slots > slots ? " (some not shown)" : "", curr_exited.threads, dt);
+        printf("%-8s %7s %7s %7s %7s %7s %7s %7s %7s\n", "tid", "locks", "tries",
+               "commits", "conflct", "ovrflow", "explct", "cycles", "tm_cyc");
+        tm_stats_t sum_now = curr_exited, sum_then = prev_exited;
+        for (int i=0; i<n; i++) {
+            // the old thread's counts moved to exited, so they stay in the
+            // total, but a recycled slot counts from zero for its new thread
+            add_stats(&sum_now, &curr[i]);
+            add_stats(&sum_then, &prev[i]);
+            if (curr[i].tid != prev[i].tid) {
+                tm_stats_t *next = prev[i].next;
+                memset(&prev[i], 0, sizeof(tm_stats_t));
+                prev[i].next = next;
+            }
+            if (curr[i].tid == 0)
+                continue;
+            char who[16];
+            snprintf(who, sizeof(who), "%d", curr[i].tid);
+            print_row(who, &curr[i], &prev[i], dt);
+        }
+        print_row("total", &sum_now, &sum_then, dt);
+        fflush(stdout);
+
+        tm_stats_t *tmp = prev;
+        prev = curr;
+        curr = tmp;
+        prev_exited = curr_exited;
+        then = now;
+        if (!alive) {
+            printf("process %d exited\n", pid);
+            break;
+        }
+    }
+    free(prev);
+    free(curr);
+    return 0;
+}
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE // for syscall()
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -11,13 +13,23 @@
 #include <errno.h>
 #include <assert.h>
 #include <signal.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
 
 #include "txlock.h"
 #include "txutil.h"
 #include "txcond.h"
+#include "txlock_inline.h"
+#include "txlock_internal.h"
 
 _Static_assert(sizeof(txlock_t) == sizeof(pthread_mutex_t), "must be same size as pthreads for drop in replacement");
 _Static_assert(sizeof(txcond_t) == sizeof(pthread_cond_t), "must be same size as pthreads for drop in replacement");
+_Static_assert(sizeof(txrwlock_t) == sizeof(pthread_rwlock_t), "must be same size as pthreads for drop in replacement");
 
 // Library search paths
 #if defined(__powerpc__) || defined(__powerpc64__)
@@ -29,674 +41,938 @@ static void *libpthread_handle = 0;
 
 
 
-// Function pointers used to dispatch lock methods
-typedef int (*txlock_func_t)(txlock_t *);
-typedef int (*txlock_func_alloc_t)(txlock_t **);
-static txlock_func_t func_tl_lock = 0;
-static txlock_func_t func_tl_trylock = 0;
-static txlock_func_t func_tl_unlock = 0;
+// The optimistic-read version (see txlock_inline.h) only fits
+// in lock types that leave the end of the slot alone
+static bool seq_versioned = false;
+
+// reader-writer locks dispatch through these
+static txrwlock_func_t func_tl_rdlock = 0;
+static txrwlock_func_t func_tl_wrlock = 0;
+static txrwlock_func_t func_tl_tryrdlock = 0;
+static txrwlock_func_t func_tl_trywrlock = 0;
+static txrwlock_func_t func_tl_rwunlock = 0;
 
-// txlock interface, dispatches to above function
-// pointers
-int tl_lock(txlock_t *l) { return func_tl_lock(l); }
-int tl_trylock(txlock_t *l) { return func_tl_trylock(l); }
-int tl_unlock(txlock_t *l) { return func_tl_unlock(l); }
+int tl_rdlock(txrwlock_t *l) { return func_tl_rdlock(l); }
+int tl_wrlock(txrwlock_t *l) { return func_tl_wrlock(l); }
+int tl_tryrdlock(txrwlock_t *l) { return func_tl_tryrdlock(l); }
+int tl_trywrlock(txrwlock_t *l) { return func_tl_trywrlock(l); }
+int tl_rwunlock(txrwlock_t *l) { return func_tl_rwunlock(l); }
 
 
 // Function pointers back into libpthreads implementations
 // (these are set on library load)
 //typedef int (*fun_pthread_mutex_init_t)(pthread_mutex_t*, const pthread_mutexattr_t*);
 //static fun_pthread_mutex_init_t libpthread_mutex_init = 0;
-static txlock_func_t libpthread_mutex_lock = 0;
-static txlock_func_t libpthread_mutex_trylock = 0;
-static txlock_func_t libpthread_mutex_unlock = 0;
+txlock_func_t libpthread_mutex_lock = 0;
+txlock_func_t libpthread_mutex_trylock = 0;
+txlock_func_t libpthread_mutex_unlock = 0;
+txrwlock_func_t libpthread_rwlock_rdlock = 0;
+txrwlock_func_t libpthread_rwlock_wrlock = 0;
+txrwlock_func_t libpthread_rwlock_tryrdlock = 0;
+txrwlock_func_t libpthread_rwlock_trywrlock = 0;
+txrwlock_func_t libpthread_rwlock_unlock = 0;
+typedef int (*fun_pthread_rwlock_timed_t)(void*, const struct timespec*);
+typedef int (*fun_pthread_rwlock_clock_t)(void*, clockid_t, const struct timespec*);
+static fun_pthread_rwlock_timed_t libpthread_rwlock_timedrdlock = 0;
+static fun_pthread_rwlock_timed_t libpthread_rwlock_timedwrlock = 0;
+static fun_pthread_rwlock_clock_t libpthread_rwlock_clockrdlock = 0; // glibc 2.30+
+static fun_pthread_rwlock_clock_t libpthread_rwlock_clockwrlock = 0;
 static void (*libpthread_exit)(void *) = 0;
 static int (*libpthread_create)(pthread_t *thread, const pthread_attr_t *attr, void *(*start_routine) (void *), void *arg) = 0;
 
 
-
-// test-and-set lock =========================
+// queue lock qnodes =========================
 //
-struct _tas_lock_t {
-    union{
-        struct{
-            volatile int32_t val;
-            volatile int16_t ready;
-            volatile int16_t cnt;
-        };
-        volatile int64_t all;
-    };
 
-} __attribute__((__packed__));
+__thread mcs_node_t* my_free_nodes = NULL;
+static __thread int my_numa_node = -1;
 
-typedef struct _tas_lock_t tas_lock_t;
+// Nodes left behind by exited threads, pooled by the NUMA node they live on
+// so a new thread reuses memory that is local to it.
+#define MCS_NODE_BATCH 8
 
-inline int tatas(volatile int32_t* val, int32_t v) {
-    return *val || __sync_lock_test_and_set(val, v);
+typedef struct {
+  utility_lock_t lk;
+  mcs_node_t* head;
+} __attribute__((aligned(CACHE_LINE_SIZE))) mcs_node_pool_t;
+
+static mcs_node_pool_t mcs_node_pools[TL_MAX_NUMA_NODES];
+static pthread_key_t mcs_nodes_key;
+static bool mcs_nodes_key_ready = false;
+
+// pthread key destructor, hands the exiting thread's nodes to the pools
+static void release_thread_nodes(void* unused) {
+  while (my_free_nodes != NULL) {
+    mcs_node_t* node = my_free_nodes;
+    my_free_nodes = node->list_next;
+    mcs_node_pool_t* pool = &mcs_node_pools[node->home];
+    ul_lock(&pool->lk);
+    node->list_next = pool->head;
+    pool->head = node;
+    ul_unlock(&pool->lk);
+  }
 }
 
-static int tas_lock(tas_lock_t *l) {
-    TM_STATS_ADD(my_tm_stats->locks, 1);
-    if (tatas(&l->val, 1)) {
-        int s = spin_begin();
-        do {
-            s = spin_wait(s);
-        } while (tatas(&l->val, 1));
-    }
-    TM_STATS_SUB(my_tm_stats->cycles, RDTSC());
-    return 0;
+static bool reuse_pooled_nodes(){
+  mcs_node_pool_t* pool = &mcs_node_pools[my_numa_node];
+  if (pool->head == NULL)
+    return false;
+  ul_lock(&pool->lk);
+  for (int i = 0; i<MCS_NODE_BATCH && pool->head!=NULL; i++) {
+    mcs_node_t* node = pool->head;
+    pool->head = node->list_next;
+    node->list_next = my_free_nodes;
+    my_free_nodes = node;
+  }
+  ul_unlock(&pool->lk);
+  return my_free_nodes != NULL;
 }
 
-static int tas_trylock(tas_lock_t *l) {
-    if(tatas(&l->val, 1) == 0){
-        TM_STATS_ADD(my_tm_stats->locks, 1);
-        TM_STATS_SUB(my_tm_stats->cycles, RDTSC());
-        return 0;
-    }
-    return 1;
+void alloc_more_nodes(){
+  if (my_numa_node < 0) {
+    my_numa_node = tl_numa_node();
+    // any non-NULL value makes the destructor run at thread exit; a lock
+    // taken before init_lib_txlock is registered there
+    if (mcs_nodes_key_ready)
+      pthread_setspecific(mcs_nodes_key, &my_free_nodes);
+  }
+  if (reuse_pooled_nodes())
+    return;
+
+  // map a fresh page, ask for it on our node, and first-touch it from
+  // this thread (the mbind is only a hint, it may be disallowed)
+  const size_t len = sysconf(_SC_PAGESIZE);
+  const int NUM_NODES = len / sizeof(mcs_node_t);
+  mcs_node_t* nodes = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  assert(nodes!=MAP_FAILED);
+  unsigned long mask = 1UL << my_numa_node;
+  syscall(SYS_mbind, nodes, len, MPOL_PREFERRED, &mask, sizeof(mask)*8, 0);
+  for(int i = 0; i<NUM_NODES; i++){
+    nodes[i].list_next = &nodes[i+1];
+    nodes[i].wait = 1;
+    nodes[i].speculate = true;
+    nodes[i].lock = NULL;
+    nodes[i].lock_next=NULL;
+    nodes[i].cnt = 0;
+    nodes[i].home = my_numa_node;
+  }
+  nodes[NUM_NODES-1].list_next=NULL;
+  my_free_nodes = nodes;
 }
 
-static int tas_unlock(tas_lock_t *l) {
-    __sync_lock_release(&l->val);
-    TM_STATS_ADD(my_tm_stats->cycles, RDTSC());
-    return 0;
+#define LOCK_LINES_CHUNK (64*1024)
+
+static utility_lock_t lock_lines_lk;
+static char* lock_lines_next = NULL;
+static char* lock_lines_end = NULL;
+
+void* alloc_lock_lines(size_t size){
+  size = (size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+  ul_lock(&lock_lines_lk);
+  if ((size_t)(lock_lines_end - lock_lines_next) < size) {
+    size_t len = size > LOCK_LINES_CHUNK ? size : LOCK_LINES_CHUNK;
+    char* chunk = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    assert(chunk!=MAP_FAILED);
+    lock_lines_next = chunk;
+    lock_lines_end = chunk + len;
+  }
+  void* lines = lock_lines_next;
+  lock_lines_next += size;
+  ul_unlock(&lock_lines_lk);
+  return lines;
 }
 
-
-// test-and-set TM lock =========================
+// function dispatch =========================
 //
+// tl_lock, tl_trylock and tl_unlock are IFUNCs resolved to the chosen
+// type's methods on load, from the table for the LIBTXLOCK_STATS level
 
-static int tas_lock_hle(tas_lock_t *l) {
-  int tries = 0;
-  int s = spin_begin();
+static const char *stats_levels[] = {"off", "counts", "timing"};
+static lock_type_t *lock_tables[] = {lock_types_off, lock_types_counts, lock_types_timing};
+static rwlock_type_t *rwlock_tables[] = {rwlock_types_off, rwlock_types_counts, rwlock_types_timing};
+static int stats_level = -1;
 
-  while (enter_htm(0)) {
-    tries++;
+static lock_type_t *using_lock_type = &lock_types_counts[2];
 
-    if(tries>=TK_NUM_TRIES){
-      TM_STATS_ADD(my_tm_stats->locks, 1);
-      while (tatas(&l->val, 1)){s = spin_wait(s);}
-      break;
-    } else {
-      s = spin_wait(s);
-    }
-  }
-
-  // locked by other thread, waiting for abort
-  if (HTM_IS_ACTIVE() && (l->val==1)) {
-    while (1)
-     spin_wait(spin_begin());
-  }
+// Looks up LIBTXLOCK_LOCK for the IFUNC resolvers. They run while objects
+// are still being relocated, before libc has set up environ, so then we read
+// the variable from /proc instead. The choice is remembered, so that
+// init_lib_txlock sets up for the same lock type the entry points bound to.
+static lock_type_t *env_lock_type = NULL;
 
-  return 0;
+static bool same_name(const char *a, const char *b) {
+    while (*a && *a == *b) {a++; b++;}
+    return *a == *b;
 }
 
-static int tas_trylock_hle(tas_lock_t *l) {
-  // TODO: 
-  assert(0);
+static lock_type_t *lock_type_named(lock_type_t *types, const char *name) {
+    for (size_t t=0; t<TL_NUM_LOCK_TYPES; t++) {
+        if (same_name(name, types[t].name)) {return &types[t];}
+    }
+    return NULL;
 }
 
-static int tas_unlock_hle(tas_lock_t *l) {
-  if (HTM_IS_ACTIVE()) { // in htm
-    HTM_END();
-    TM_STATS_ADD(my_tm_stats->commits, 1);
-  } else { // not in HTM
-    __sync_lock_release(&l->val);
-    TM_STATS_ADD(my_tm_stats->cycles, RDTSC());
-  }
-  return 0;
+// Bare system call, the libc wrappers may not be bound yet either
+static inline long early_syscall(long nr, long a, long b, long c) {
+#if defined(__x86_64__) || defined(__x86_64)
+    long ret;
+    __asm__ volatile ("syscall" : "=a"(ret) : "a"(nr), "D"(a), "S"(b), "d"(c)
+                      : "rcx", "r11", "memory");
+    return ret;
+#elif defined(__powerpc64__) || defined(__ppc64__)
+    register long r0 __asm__("r0") = nr;
+    register long r3 __asm__("r3") = a;
+    register long r4 __asm__("r4") = b;
+    register long r5 __asm__("r5") = c;
+    __asm__ volatile ("sc\n\tbns+ 1f\n\tneg %1,%1\n1:"
+                      : "+r"(r0), "+r"(r3), "+r"(r4), "+r"(r5)
+                      :: "r6", "r7", "r8", "r9", "r10", "r11", "r12",
+                         "ctr", "cr0", "memory");
+    return r3;
+#else
+    return syscall(nr, a, b, c);
+#endif
 }
 
+static const char *early_getenv(const char *var, char *value, size_t size) {
+    // no strlen: gcc turns length loops into libc calls, unbound this early
+    if (environ) {
+        for (char **env = environ; *env; env++) {
+            size_t i = 0;
+            while (var[i] && (*env)[i] == var[i]) {i++;}
+            if (!var[i] && (*env)[i] == '=') {return *env + i + 1;}
+        }
+        return NULL;
+    }
 
-// test-and-set TM lock =========================
-//
-
-static int tas_lock_tm(tas_lock_t *l) {
-  int tries = 0;
-  if (spec_entry == 0) { // not in HTM
-    TM_STATS_ADD(my_tm_stats->locks, 1);
-    while (tatas(&l->val, 1)) {
-      // if lock is held, start speculating
-      if(enter_htm(l)==0){return 0;}
-      else{tries++;}
-      // fall to the lock if out of tries
-      if(tries>=TK_NUM_TRIES){
-        int s = spin_begin();
-        while (tatas(&l->val, 1)){s = spin_wait(s);}
-        break;
-      }
+    int fd = early_syscall(SYS_open, (long)"/proc/self/environ", O_RDONLY, 0);
+    if (fd < 0) {return NULL;}
+    char buf[1024];
+    ssize_t n;
+    size_t at = 0, v = 0;
+    bool match = true, past = false, found = false;
+    while (!found && (n = early_syscall(SYS_read, fd, (long)buf, sizeof(buf))) > 0) {
+        for (ssize_t i=0; i<n; i++) {
+            char c = buf[i];
+            if (c == '\0') {
+                if (match && past) {found = true; break;}
+                at = 0; v = 0; match = true; past = false;
+                continue;
+            }
+            if (past) {if (match && v < size-1) {value[v++] = c;}}
+            else if (var[at]) {match = match && c == var[at++];}
+            else {match = match && c == '='; past = true;}
+        }
     }
-  }
-  TM_STATS_SUB(my_tm_stats->cycles, RDTSC());
-  return 0;
+    early_syscall(SYS_close, fd, 0, 0);
+    if (!found) {return NULL;}
+    value[v] = '\0';
+    return value;
 }
 
-static int tas_trylock_tm(tas_lock_t *l) {
-  if (spec_entry == 0) { // not in HTM
-    if(tatas(&l->val, 1)==0){
-      TM_STATS_ADD(my_tm_stats->locks, 1);
-      TM_STATS_SUB(my_tm_stats->cycles, RDTSC());
-      return 0;
+// Defined by programs built with TXLOCK_TYPE, whose inlined calls must
+// agree with the library's. Each of their files leaves the type it inlines
+// in the tl_inline_types section too, see check_inline_types.
+extern const char tl_inline_lock_type[] __attribute__((weak));
+extern const tl_inline_type_t __start_tl_inline_types[] __attribute__((weak));
+extern const tl_inline_type_t __stop_tl_inline_types[] __attribute__((weak));
+
+static lock_type_t *lock_type_from_env() {
+    if (!env_lock_type) {
+        char value[32];
+        const char *level = early_getenv("LIBTXLOCK_STATS", value, sizeof(value));
+        stats_level = 1; // counts
+        for (int i=0; level && i<3; i++) {
+            if (same_name(level, stats_levels[i])) {stats_level = i;}
+        }
+        lock_type_t *types = lock_tables[stats_level];
+
+        const char *name = early_getenv("LIBTXLOCK_LOCK", value, sizeof(value));
+        if (tl_inline_lock_type) {name = tl_inline_lock_type;}
+        lock_type_t *type = name ? lock_type_named(types, name) : NULL;
+        env_lock_type = type ? type : &types[2];
+
+        // profiling, policies and timing put wrappers in front of the type's
+        // entry points
+        const char *sample = early_getenv("LIBTXLOCK_PROFILE", value, sizeof(value));
+        tl_profile_sample = 0;
+        while (sample && *sample >= '0' && *sample <= '9') {
+            tl_profile_sample = 10*tl_profile_sample + (*sample++ - '0');
+        }
+        tl_profile_type = env_lock_type;
+        tl_timed = stats_level == 2;
+        tl_sited = tl_profile_sample || tl_timed ||
+                   early_getenv("LIBTXLOCK_POLICY", value, sizeof(value));
     }
-    else{return 1;}
-  }
-  return 0;
+    return env_lock_type;
 }
 
-static int tas_unlock_tm(tas_lock_t *l) {
-  if (spec_entry) { // in htm
-  } else { // not in HTM
-    __sync_lock_release(&l->val);
-    TM_STATS_ADD(my_tm_stats->cycles, RDTSC());
-  }
-  return 0;
+// txlock interface, bound to the chosen lock type's methods on load. A call
+// still goes through the PLT like any other call into a shared library (or
+// the IRELATIVE slot in a static link), but there's no wrapper loading one
+// of our function pointers any more.
+static txlock_func_t resolve_tl_lock() {
+    lock_type_t *type = lock_type_from_env();
+    return tl_sited ? tl_lock_profiled : type->tl_lock_fun;
+}
+static txlock_func_t resolve_tl_trylock() {
+    lock_type_t *type = lock_type_from_env();
+    return tl_sited ? tl_trylock_profiled : type->tl_trylock_fun;
+}
+static txlock_func_t resolve_tl_unlock() {
+    lock_type_t *type = lock_type_from_env();
+    return tl_sited ? tl_unlock_profiled : type->tl_unlock_fun;
 }
 
-// tas priority lock =========================
-//
+int tl_lock(txlock_t *l) __attribute__((ifunc("resolve_tl_lock")));
+int tl_trylock(txlock_t *l) __attribute__((ifunc("resolve_tl_trylock")));
+int tl_unlock(txlock_t *l) __attribute__((ifunc("resolve_tl_unlock")));
+
+static rwlock_type_t *using_rwlock_type = &rwlock_types_counts[0];
+static bool rwlock_is_pthread = true;
+
+// Timed reader-writer locks. The pthread type hands them to libpthread,
+// the others have nowhere to sleep with a timeout, so they retry the
+// trylock until the deadline passes.
+static bool timed_out(clockid_t clock, const struct timespec *abs_timeout) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec > abs_timeout->tv_sec ||
+           (now.tv_sec == abs_timeout->tv_sec && now.tv_nsec >= abs_timeout->tv_nsec);
+}
 
-static int tas_priority_lock_tm(tas_lock_t *lk) {
-  int tries = 0;
-  if (spec_entry == 0) { // not in HTM
-    TM_STATS_ADD(my_tm_stats->locks, 1);
-    tas_lock_t copy;
-    int s = spin_begin();
-    while(true){
-			copy.all = lk->all;
-			if(copy.ready==0){
-					if (!tatas(&lk->val, 1)) {
-							break;
-					}
-			}
-			if(copy.ready < TK_MAX_DISTANCE-TK_MIN_DISTANCE){
-				if(enter_htm(lk)==0){
-					//if(lk->val!=1){HTM_ABORT(1);}
-					return 0;
-				}
-				else{
-					__sync_fetch_and_add(&lk->ready,1);
-					while (tatas(&lk->val, 1)){}
-					__sync_fetch_and_add(&lk->ready,-1);
-					break;
-				}
-			}
-			/*
-			if(copy.cnt < TK_MAX_DISTANCE-TK_MIN_DISTANCE){
-				bool tmp = __sync_bool_compare_and_swap(&lk->cnt,copy.cnt,copy.cnt+1);
-				//if(tmp == 0){}
-				//else 
-					if(enter_htm(lk)==0){
-					//if(lk->val!=1){HTM_ABORT(1);}
-					return 0;
-				}
-				else{
-					//__sync_fetch_and_add(&lk->cnt,-1);
-					__sync_fetch_and_add(&lk->ready,1);
-					s = spin_begin();
-					while (tatas(&lk->val, 1)){s = spin_wait(s);}
-					__sync_fetch_and_add(&lk->ready,-1);
-					break;
-				}
-			}*/
-			/*
-			if(copy.cnt < TK_MAX_DISTANCE-TK_MIN_DISTANCE){
-				lk->cnt=1;
-				if(enter_htm(lk)==0){
-					return 0;
-				}
-				else{
-					lk->ready=1;
-					lk->cnt=0;
-					while (tatas(&lk->val, 1)){if(lk->ready!=1){lk->ready=1;}}
-					lk->ready=0;
-					break;
-				}
-			}*/
-			s = spin_wait(s);
+static int rw_timed(txrwlock_func_t trylock, txrwlock_t *l, clockid_t clock,
+                    const struct timespec *abs_timeout) {
+    if (abs_timeout->tv_nsec < 0 || abs_timeout->tv_nsec >= 1000000000L)
+        return EINVAL;
+    int ret;
+    while ((ret = trylock(l)) == EBUSY) {
+        if (timed_out(clock, abs_timeout))
+            return ETIMEDOUT;
+        sched_yield();
     }
-  }
-  TM_STATS_SUB(my_tm_stats->cycles, rdtsc());
-  return 0;
+    return ret;
 }
 
-static int tas_priority_trylock_tm(tas_lock_t *lk) {
-  if (spec_entry == 0) { // not in HTM
-    tas_lock_t copy;
-    copy.all = lk->all;
-    if(copy.ready==0 && (tatas(&lk->val, 1)==0)){
-      TM_STATS_ADD(my_tm_stats->locks, 1);
-      TM_STATS_SUB(my_tm_stats->cycles, RDTSC());
-      return 0;
+int tl_timedrdlock(txrwlock_t *l, clockid_t clock, const struct timespec *abs_timeout) {
+    if (rwlock_is_pthread) {
+        if (clock == CLOCK_REALTIME && libpthread_rwlock_timedrdlock)
+            return libpthread_rwlock_timedrdlock(l, abs_timeout);
+        if (libpthread_rwlock_clockrdlock)
+            return libpthread_rwlock_clockrdlock(l, clock, abs_timeout);
     }
-    else{return 1;}
-  }
-  return 0;
+    return rw_timed(func_tl_tryrdlock, l, clock, abs_timeout);
 }
 
-static int tas_priority_unlock_tm(tas_lock_t *l) {
-  if (spec_entry == 0) { // not in HTM
-    __sync_lock_release(&l->val);
-    TM_STATS_ADD(my_tm_stats->cycles, RDTSC());
-  }
-  return 0;
+int tl_timedwrlock(txrwlock_t *l, clockid_t clock, const struct timespec *abs_timeout) {
+    if (rwlock_is_pthread) {
+        if (clock == CLOCK_REALTIME && libpthread_rwlock_timedwrlock)
+            return libpthread_rwlock_timedwrlock(l, abs_timeout);
+        if (libpthread_rwlock_clockwrlock)
+            return libpthread_rwlock_clockwrlock(l, clock, abs_timeout);
+    }
+    return rw_timed(func_tl_trywrlock, l, clock, abs_timeout);
 }
 
-// ticket lock =========================
-//
-
-struct _ticket_lock_t {
-  volatile uint32_t next;
-  volatile uint32_t now;
-} __attribute__((__packed__));
 
-typedef struct _ticket_lock_t ticket_lock_t;
-
-static int ticket_lock(ticket_lock_t *l) {
-    TM_STATS_ADD(my_tm_stats->locks, 1);
-    uint32_t my_ticket = __sync_fetch_and_add(&l->next, 1);
-    while (my_ticket != l->now) {
-        uint32_t dist = my_ticket - l->now;
-        spin_wait(16*dist);
+// optimistic reads =========================
+//
+// A stamp is the even version seen by tl_read_begin, possibly tagged with
+// how the read section is really running: under the lock itself, once this
+// thread has failed validation SEQ_MAX_FAILURES times in a row (or if the
+// lock type leaves no room for a version), or inside a transaction, if
+// LIBTXLOCK_HTM_READS is set.
+
+#define SEQ_MAX_FAILURES 4
+#define TL_STAMP_LOCKED (1ULL<<32)
+#define TL_STAMP_HTM    (1ULL<<33)
+
+static __thread int seq_failures = 0;
+
+tl_stamp_t tl_read_begin(txlock_t *l) {
+    if (!seq_versioned || seq_failures >= SEQ_MAX_FAILURES) {
+        // readers don't change anything, so no version bump
+        using_lock_type->lock_fun(l);
+        return TL_STAMP_LOCKED | *tl_seq(l);
     }
-    TM_STATS_SUB(my_tm_stats->cycles, RDTSC());
-    return 0;
-}
-
-static int ticket_trylock(ticket_lock_t *l) {
-    ticket_lock_t t, n;
-    t.now = t.next = l->now;
-    n.now = t.now;
-    n.next = t.next+1;
 
-    if((!(__sync_bool_compare_and_swap((int64_t*)l, *(int64_t*)&t, *(int64_t*)&n))) == 0){
-      TM_STATS_ADD(my_tm_stats->locks, 1);
-      TM_STATS_SUB(my_tm_stats->cycles, RDTSC());
-      return 0;
+    uint32_t v;
+    if (TM_SEQ_READS && spec_entry == 0 && enter_htm(l) == 0) {
+        // reading the version subscribes us to the next writer
+        v = *tl_seq(l);
+        if (v & 1) {HTM_ABORT(2);}
+        return TL_STAMP_HTM | v;
     }
-    else{return 1;}
-}
 
-static int ticket_unlock(ticket_lock_t *l) {
-    l->now++;
-    TM_STATS_ADD(my_tm_stats->cycles, RDTSC());
-    return 0;
+    // wait out a writer that's inside
+    int s = spin_begin();
+    while ((v = *tl_seq(l)) & 1) {s = spin_wait(s);}
+    __atomic_thread_fence(__ATOMIC_ACQUIRE); // version before the data
+    return v;
 }
 
-// ticket lock TM =========================
-//
-//
-static int ticket_lock_tm(ticket_lock_t *l) {
-    if (spec_entry)
-        return 0;
-
-    TM_STATS_ADD(my_tm_stats->locks, 1);
-    uint32_t tries = 0;
-    uint32_t my_ticket = __sync_fetch_and_add(&l->next, 1);
-    while (my_ticket != l->now) {
-        uint32_t dist = my_ticket - l->now;
-        if (dist <= TK_MAX_DISTANCE && dist >= TK_MIN_DISTANCE && tries < TK_NUM_TRIES) {
-            // if lock is held, start speculating
-            if(enter_htm(l)==0){
-				if(l->now==my_ticket){HTM_ABORT(1);}				
-				return 0;
-			}
-            else{
-                spin_wait(8);
-                tries++;
-            }
-        } else {
-            spin_wait(16*dist);
-        }
+int tl_read_validate(txlock_t *l, tl_stamp_t stamp) {
+    if (stamp & TL_STAMP_LOCKED) {
+        using_lock_type->unlock_fun(l);
+        seq_failures = 0;
+        return 1;
     }
-    TM_STATS_SUB(my_tm_stats->cycles, RDTSC());
-    return 0;
-}
-
-static int ticket_trylock_tm(ticket_lock_t *l) {
-    if (spec_entry) { // in htm
-        // nothing
-    } else { // not in HTM
-        ticket_trylock(l);
+    if (stamp & TL_STAMP_HTM) {
+        HTM_END();
+        spec_entry = 0;
+        TM_STATS_ADD(MY_TM_STATS->commits, 1);
+        return 1;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE); // data before the version
+    if (*tl_seq(l) == (uint32_t)stamp) {
+        seq_failures = 0;
+        return 1;
     }
+    seq_failures++;
     return 0;
 }
 
-static int ticket_unlock_tm(ticket_lock_t *l) {
-    if (spec_entry) { // in htm
-       //if (spec_entry == l) {
-       // HTM_ABORT(7);
-       //}
-    } else { // not in HTM
-        l->now++;
-        TM_STATS_ADD(my_tm_stats->cycles, RDTSC());
+int tl_read_to_write(txlock_t *l, tl_stamp_t stamp) {
+    if (stamp & TL_STAMP_LOCKED) {
+        // already hold it, just start writing
+        seq_failures = 0;
+        seq_write_begin(l);
+        return 1;
     }
-    return 0;
+    if (stamp & TL_STAMP_HTM) {
+        HTM_END();
+        spec_entry = 0;
+        TM_STATS_ADD(MY_TM_STATS->commits, 1);
+    }
+    tl_lock(l);
+    // still valid if ours is the only bump since the read began
+    return *tl_seq(l) == (uint32_t)stamp + 1;
 }
 
 
-// pthreads =====================
-//
-
-static int pthread_lock(void *lk){
-    TM_STATS_ADD(my_tm_stats->locks, 1);
-    int retval = libpthread_mutex_lock(lk);
-    TM_STATS_SUB(my_tm_stats->cycles, RDTSC());
-    return retval;
-}
-static int pthread_trylock(void *lk){
-    int retval = libpthread_mutex_trylock(lk);
-    if(retval==0){
-        TM_STATS_ADD(my_tm_stats->locks, 1);
-        TM_STATS_SUB(my_tm_stats->cycles, RDTSC());
-    }
-    return retval;
-}
-static int pthread_unlock(void *lk){
-    int retval = libpthread_mutex_unlock(lk);
-    TM_STATS_ADD(my_tm_stats->cycles, RDTSC());
-    return retval;
+static int64_t elapsed_ns(struct timespec *a, struct timespec *b) {
+    return (b->tv_sec - a->tv_sec)*1000000000L + (b->tv_nsec - a->tv_nsec);
 }
 
+// Size the spin budget of the parking locks to roughly what sleeping would
+// cost: a futex wait and wake plus the two context switches, which we
+// approximate as four bare futex syscalls.
+static void calibrate_park_spin() {
+    const int N = 64;
+    const int RELAX_PER_CALL = 64;
+    volatile int32_t word = 0;
+    struct timespec t0, t1, t2;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i=0; i<N; i++)
+        futex_wake(&word, 1); // nobody waits on word, so this is just the syscall
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (int i=0; i<N*RELAX_PER_CALL; i++)
+        cpu_relax();
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    int64_t syscall_ns = elapsed_ns(&t0, &t1);
+    int64_t relax_ns = elapsed_ns(&t1, &t2);
+    if (relax_ns <= 0)
+        relax_ns = 1;
+    int64_t spins = 4 * syscall_ns * RELAX_PER_CALL / relax_ns;
+    if (spins < SPIN_INIT)
+        spins = SPIN_INIT;
+    if (spins > SPIN_PARK_MAX)
+        spins = SPIN_PARK_MAX;
+    SPIN_PARK = spins;
+}
 
-// pthreads TM =========================
+// live stats =========================
 //
+// With LIBTXLOCK_SHM=1 the threads' tm_stats_t are slots of a shared mapping
+// of /dev/shm/txlock.<pid> (see txutil.h), so txlock-top can watch a running
+// process. Threads past LIBTXLOCK_SHM_THREADS (default 1024) get private
+// stats, which only make it into the report at exit.
+
+static tl_shm_header_t *shm_stats = NULL;
+static char shm_path[64];
+
+// counts of the threads that exited, in the shm header if there is one
+static tm_stats_t *exited_stats = &tm_stats;
+
+static void open_shm_stats() {
+    const char* env = getenv("LIBTXLOCK_SHM");
+    if (!env || !atoi(env) || stats_level == 0)
+        return;
+    int slots = 1024;
+    if ((env = getenv("LIBTXLOCK_SHM_THREADS")) != NULL && atoi(env) > 0)
+        slots = atoi(env);
+    size_t size = sizeof(tl_shm_header_t) + slots*sizeof(tm_stats_t);
+
+    snprintf(shm_path, sizeof(shm_path), "/dev/shm/txlock.%d", getpid());
+    int fd = open(shm_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(shm_path);
+        return;
+    }
+    void *m = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        perror(shm_path);
+        unlink(shm_path);
+        return;
+    }
 
-static int pthread_lock_tm(pthread_mutex_t *l) {
-  if (spec_entry){return 0;}
-
-  TM_STATS_ADD(my_tm_stats->locks, 1);
-  int tries = 0;
-  while (libpthread_mutex_trylock((void*)l) != 0) {
-    if(enter_htm(l)==0){return 0;}
-    else{tries++;}
+    // the file starts zeroed; publish the header once it's complete
+    shm_stats = m;
+    shm_stats->version = TL_SHM_VERSION;
+    shm_stats->pid = getpid();
+    shm_stats->stats_level = stats_level;
+    shm_stats->num_slots = slots;
+    strncpy(shm_stats->lock_name, using_lock_type->name, sizeof(shm_stats->lock_name)-1);
+    shm_stats->exited = *exited_stats;
+    exited_stats = &shm_stats->exited;
+    __sync_synchronize();
+    shm_stats->magic = TL_SHM_MAGIC;
+}
 
-    if(tries>=TK_NUM_TRIES){
-        libpthread_mutex_lock((void*)l);
-        break;
-    }
-  }
-  TM_STATS_SUB(my_tm_stats->cycles, RDTSC());
-  return 0;
-}
-
-static int pthread_trylock_tm(pthread_mutex_t *l) {
-    if (spec_entry) { // in htm
-        // nothing
-        return 0;
-    } else { // not in HTM
-        int retval = libpthread_mutex_trylock((void*)l);
-        if(retval==0){
-            TM_STATS_ADD(my_tm_stats->locks, 1);
-            TM_STATS_ADD(my_tm_stats->cycles, RDTSC());
+// per-thread stats =========================
+//
+// A thread gets its stats on its first lock, or in tl_thread_enter. When it
+// exits, stats_key's destructor folds them into exited_stats and puts the
+// block on a free list for the next thread, so there are never more blocks
+// than threads alive at once. Every block stays on tm_stats_head.
+
+static pthread_key_t stats_key;
+static bool stats_key_ready = false;
+static utility_lock_t stats_lock; // exited_stats, freeing blocks and free_stats
+static tm_stats_t *free_stats = NULL;
+
+// with LIBTXLOCK_REPORT, the first exited threads' own stats for its list
+static tm_stats_t *exited_log = NULL;
+static int exited_log_size = 0;
+static int exited_logged = 0;
+
+static tm_stats_t* alloc_tm_stats() {
+    tm_stats_t* stats = NULL;
+    if (free_stats) {
+        ul_lock(&stats_lock);
+        stats = free_stats;
+        if (stats)
+            free_stats = stats->free_next;
+        ul_unlock(&stats_lock);
+        if (stats) {
+            stats->tid = syscall(SYS_gettid);
+            return stats;
         }
-        return retval;
     }
-}
 
-static int pthread_unlock_tm(pthread_mutex_t *l) {
-    if (spec_entry) { // in htm
-       //if (spec_entry == l) {
-       // HTM_ABORT(7);
-       //}
-    } else { // not in HTM
-        libpthread_mutex_unlock((void*)l);
-        TM_STATS_ADD(my_tm_stats->cycles, RDTSC());
+    if (shm_stats) {
+        int i = __sync_fetch_and_add(&shm_stats->used_slots, 1);
+        if (i < shm_stats->num_slots)
+            stats = (tm_stats_t*)(shm_stats + 1) + i;
     }
-    return 0;
+    if (!stats) {
+        // not malloc, which may take a pthread mutex itself
+        void *m = mmap(NULL, sizeof(tm_stats_t), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED)
+            return NULL;
+        stats = m;
+    }
+    stats->tid = syscall(SYS_gettid);
+    do {
+        stats->next = tm_stats_head;
+    } while(!__sync_bool_compare_and_swap(&tm_stats_head, stats->next, stats));
+    return stats;
 }
 
-
-
-// queue lock ================================
-struct _mcs_lock_t;
-
-struct _mcs_node_t{
-  struct _mcs_node_t* volatile lock_next;
-  volatile bool wait;
-  volatile bool speculate;
-  volatile uint64_t cnt;
-  struct _mcs_lock_t* lock;
-  struct _mcs_node_t* list_next;
-  struct _mcs_node_t* list_prev;
-} __attribute__((__packed__));
-
-typedef struct _mcs_node_t mcs_node_t;
-
-static __thread mcs_node_t* my_free_nodes = NULL;
-static __thread mcs_node_t* my_used_nodes = NULL;
-
-struct _mcs_lock_t {
-  volatile mcs_node_t* tail;
-  volatile long now_serving;
-} __attribute__((__packed__));
-
-typedef struct _mcs_lock_t mcs_lock_t;
-
-static void alloc_more_nodes(){
-  const int NUM_NODES = 8;
-  mcs_node_t* nodes = malloc(sizeof(mcs_node_t)*NUM_NODES);
-  assert(nodes!=NULL);
-  for(int i = 0; i<NUM_NODES; i++){
-    nodes[i].list_next = &nodes[i+1];
-    nodes[i].list_prev=NULL;
-    nodes[i].wait = true;
-    nodes[i].speculate = true;
-    nodes[i].lock = NULL;
-    nodes[i].lock_next=NULL;
-    nodes[i].cnt = 0;
-  }
-  nodes[NUM_NODES-1].list_next=NULL;
-  my_free_nodes = nodes;
+static void add_stats(tm_stats_t *sum, const tm_stats_t *s) {
+    sum->cycles += s->cycles;
+    sum->tm_cycles += s->tm_cycles;
+    sum->locks += s->locks;
+    sum->tries += s->tries;
+    sum->stops += s->stops;
+    sum->commits += s->commits;
+    sum->overflows += s->overflows;
+    sum->conflicts += s->conflicts;
+    sum->explicits += s->explicits;
+    sum->threads += s->threads;
 }
 
-static int inline mcs_lock_common(mcs_lock_t *lk, bool try_lock, bool tm) {
-  if (spec_entry){return 0;}
-
-  // get a free node
-  mcs_node_t* mine;
-  mine = my_free_nodes;
-  if(mine == NULL){
-    alloc_more_nodes();
-    mine = my_free_nodes;
-    assert(mine!=NULL);
-  }
-
-  // init my qnode
-  mine->lock_next = NULL;
-  mine->lock = lk;
-  mine->wait = true;
-  mine->speculate = true;
-  mine->cnt = 0;
+static void sub_stats(tm_stats_t *from, const tm_stats_t *s) {
+    from->cycles -= s->cycles;
+    from->tm_cycles -= s->tm_cycles;
+    from->locks -= s->locks;
+    from->tries -= s->tries;
+    from->stops -= s->stops;
+    from->commits -= s->commits;
+    from->overflows -= s->overflows;
+    from->conflicts -= s->conflicts;
+    from->explicits -= s->explicits;
+    from->threads -= s->threads;
+}
 
-  // then swap it into the root pointer
-  mcs_node_t* pred = NULL;
-  if(try_lock){
-    if(!__sync_bool_compare_and_swap(&lk->tail, NULL, mine)){
-      return 1; // return failure
-    }
-  }
-  else{
-    pred = (mcs_node_t*)__sync_lock_test_and_set(&lk->tail, mine);
-  }
+// pthread key destructor, runs as the owning thread exits
+static void release_thread_stats(void* stats) {
+    tm_stats_t *s = stats;
+    my_tm_stats = NULL;
+    tm_stats_t* next = s->next;
+    ul_lock(&stats_lock);
+    s->threads = 1;
+    add_stats(exited_stats, s);
+    if (exited_logged < exited_log_size)
+        exited_log[exited_logged++] = *s;
+    memset(s, 0, sizeof(tm_stats_t));
+    s->next = next;
+    s->free_next = free_stats;
+    free_stats = s;
+    ul_unlock(&stats_lock);
+}
 
-  // we know we'll use the node, so allocate it
-  // by moving node off free list and to used list
-  my_free_nodes = mine->list_next;
-  mine->list_next = my_used_nodes;
-  if(my_used_nodes!=NULL){my_used_nodes->list_prev = mine;}
-  my_used_nodes = mine;
-  mine->list_prev = NULL;
-
-  // now set my flag, point pred to me, and wait for my flag to be unset
-  if (pred != NULL) {
-    if(!tm){
-      pred->lock_next = mine;
-      __sync_synchronize(); // is this barrier needed?
-      while (mine->wait) {} // spin
+// Sums the exited and the running threads' stats into sum, and returns how
+// many threads are running. Their counters only go up, so a sum taken while
+// they run is a consistent enough point in time.
+static int sum_stats(tm_stats_t *sum) {
+    int running = 0;
+    memset(sum, 0, sizeof(tm_stats_t));
+    ul_lock(&stats_lock);
+    add_stats(sum, exited_stats);
+    for (tm_stats_t* curr = tm_stats_head; curr; curr = curr->next) {
+        if (curr->tid == 0)
+            continue; // free
+        add_stats(sum, curr);
+        running++;
     }
-    else{
-      // finish enqueing
-      pred->lock_next = mine;
-      while(pred->cnt==0){} // wait for predecessor to get its count
-      __sync_synchronize(); // is this barrier needed?
-      long cnt = pred->cnt+1;
-      mine->cnt = cnt;
-      __sync_synchronize(); // is this barrier needed?
-
-      // decide whether to speculate
-      long now_serving_copy = lk->now_serving;
-      if(now_serving_copy<cnt-TK_MIN_DISTANCE &&
-       now_serving_copy>cnt-TK_MAX_DISTANCE &&
-       spec_entry==NULL){
-        spec_entry = lk;
-        if (HTM_SIMPLE_BEGIN() == HTM_SUCCESSFUL) {
-          if(mine->speculate!=true || mine->wait!=true){
-            HTM_ABORT(0);
-          }
-          else{return 0;}
-        }
-        spec_entry=NULL;
-      }
-      // finished speculating
+    ul_unlock(&stats_lock);
+    sum->threads += running;
+    return running;
+}
 
-      // actually acquire the lock
-      while (mine->wait) {}
-      __sync_synchronize(); // is this barrier needed?
-      assert(lk->now_serving == cnt-1);
-      lk->now_serving = cnt;
-    }
-  }
-  else{
-    if(tm){
-      mine->cnt=lk->now_serving+1;
-      lk->now_serving++;
+tm_stats_t* tl_thread_stats() {
+    if (my_tm_stats == 0) {
+        my_tm_stats = alloc_tm_stats();
+        if (!my_tm_stats)
+            my_tm_stats = exited_stats; // out of memory: share, roughly
+        else if (stats_key_ready)
+            pthread_setspecific(stats_key, my_tm_stats);
     }
-  }
-
-  return 0; // return success
+    return my_tm_stats;
 }
 
-static int mcs_lock(mcs_lock_t *lk) {
-  return mcs_lock_common(lk,false,false);
-}
+// stats API =========================
+//
+// tl_stats_reset and the phases keep a base to subtract from later sums; the
+// threads' own counters are never written by anyone else.
 
+#define TL_MAX_PHASES 64
 
-static int mcs_trylock(mcs_lock_t *lk) {
-  return mcs_lock_common(lk,true,false);
+typedef struct {
+    char name[32];
+    tm_stats_t stats;
+    int64_t ns;
+} stats_phase_t;
+
+static tm_stats_t reset_base;
+static stats_phase_t phases[TL_MAX_PHASES];
+static int num_phases = 0;
+static bool phase_open = false; // phases[num_phases-1] is still counting
+static tm_stats_t phase_base;
+static struct timespec phase_start;
+static utility_lock_t phase_lock;
+
+void tl_stats_snapshot(struct tl_stats *s) {
+    tm_stats_t sum;
+    sum_stats(&sum);
+    sub_stats(&sum, &reset_base);
+    s->cycles = sum.cycles;
+    s->tm_cycles = sum.tm_cycles;
+    s->locks = sum.locks;
+    s->tries = sum.tries;
+    s->stops = sum.stops;
+    s->commits = sum.commits;
+    s->overflows = sum.overflows;
+    s->conflicts = sum.conflicts;
+    s->explicits = sum.explicits;
+    s->threads = sum.threads;
 }
 
-
-static inline void dealloc_node(mcs_node_t* mine){
-  // move node out of used list
-  mine->lock_next = NULL;
-  if(mine->list_prev!=NULL){
-    mine->list_prev->list_next = mine->list_next;
-  }
-  else{
-    my_used_nodes = mine->list_next;
-  }
-  if(mine->list_next!=NULL){
-    mine->list_next->list_prev = mine->list_prev;
-  }
-
-  // and onto free list
-  mine->list_next = my_free_nodes;
-  my_free_nodes = mine;
+void tl_stats_reset() {
+    tm_stats_t sum;
+    int running = sum_stats(&sum);
+    sum.threads -= running; // those still count after the reset
+    reset_base = sum;
 }
 
-static inline int mcs_unlock_common(mcs_lock_t *lk, bool tm) {
-
-  // traverse used list to find node
-  // (assumes we never hold a lot of locks at once)
-  mcs_node_t* mine = my_used_nodes;
-  assert(mine!=NULL);
-  while(mine->lock!=lk){
-    mine = mine->list_next;
-    assert(mine!=NULL);
-  }
-
-  // if my node is the only one, then if I can zero the lock, do so and I'm
-  // done
-  if (mine->lock_next == NULL) {
-    if (__sync_bool_compare_and_swap(&lk->tail, mine, NULL)){
-      dealloc_node(mine);
-      return 0;
+void tl_stats_phase(const char *name) {
+    tm_stats_t sum;
+    struct timespec now;
+    int running = sum_stats(&sum);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    ul_lock(&phase_lock);
+    if (phase_open) {
+        stats_phase_t *p = &phases[num_phases-1];
+        p->stats = sum;
+        sub_stats(&p->stats, &phase_base);
+        p->ns = elapsed_ns(&phase_start, &now);
+        phase_open = false;
     }
-    // uh-oh, someone arrived while I was zeroing... wait for arriver to
-    // initialize, fall out to other case
-    while (mine->lock_next == NULL) { } // spin
-  }
-
-  // halt speculators
-  if(tm){
-    mcs_node_t* current = mine->lock_next;
-    int dist = 1;
-    while(current!=NULL){
-      if(dist>=TK_MIN_DISTANCE){
-        current->speculate = false;
-      }
-      if(dist>TK_MAX_DISTANCE){break;}
-      current = current->lock_next;
-      dist++;
+    if (name && num_phases < TL_MAX_PHASES) {
+        stats_phase_t *p = &phases[num_phases++];
+        strncpy(p->name, name, sizeof(p->name)-1);
+        phase_base = sum;
+        phase_base.threads -= running;
+        phase_start = now;
+        phase_open = true;
+    } else if (name) {
+        fprintf(stderr, "LIBTXLOCK: more than %d phases, %s not counted\n", TL_MAX_PHASES, name);
     }
-  }
-  // wake spinners for speculation?????????
+    ul_unlock(&phase_lock);
+}
 
 
-  // if someone is waiting on me; set their flag to let them start
-  mine->lock_next->wait = false;
+// exit report =========================
+//
+// LIBTXLOCK_REPORT=json:path or csv:path also writes the exit report to a
+// file, with the configuration, every thread's counters (the running ones
+// and the first LIBTXLOCK_REPORT_THREADS, default 1024, that exited), the
+// phases and the latency histograms. It's written next to path and renamed
+// over it, so readers never see half a report.
+
+#define REPORT_JSON 1
+#define REPORT_CSV  2
+
+static int report_format = 0;
+static char report_path[PATH_MAX];
+static struct timespec report_start;
+
+static void setup_report() {
+    const char* env = getenv("LIBTXLOCK_REPORT");
+    if (!env || !*env)
+        return;
+    if (strncmp(env, "json:", 5) == 0)
+        report_format = REPORT_JSON;
+    else if (strncmp(env, "csv:", 4) == 0)
+        report_format = REPORT_CSV;
+    else {
+        fprintf(stderr, "LIBTXLOCK_REPORT: expected json:path or csv:path, not %s\n", env);
+        return;
+    }
+    strncpy(report_path, strchr(env, ':') + 1, sizeof(report_path)-1);
+    clock_gettime(CLOCK_MONOTONIC, &report_start);
+
+    int threads = 1024;
+    if ((env = getenv("LIBTXLOCK_REPORT_THREADS")) != NULL && atoi(env) >= 0)
+        threads = atoi(env);
+    if (threads > 0) {
+        void *m = mmap(NULL, threads*sizeof(tm_stats_t), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m != MAP_FAILED) {
+            exited_log = m;
+            exited_log_size = threads;
+        }
+    }
+}
 
-  dealloc_node(mine);
+static double ratio(int64_t a, int64_t b) {
+    return b ? (double)a/b : 0;
+}
 
-  return 0;
+static void json_string(FILE *f, const char *str) {
+    fputc('"', f);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fprintf(f, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(f, "\\u%04x", *str);
+        else
+            fputc(*str, f);
+    }
+    fputc('"', f);
 }
 
-static int mcs_unlock(mcs_lock_t *lk) {
-  return mcs_unlock_common(lk,false);
+static void csv_string(FILE *f, const char *str) {
+    fputc('"', f);
+    for (; *str; str++) {
+        if (*str == '"')
+            fputc('"', f);
+        fputc(*str, f);
+    }
+    fputc('"', f);
 }
 
+static void json_counts(FILE *f, const tm_stats_t *s) {
+    fprintf(f, "\"locks\": %ld, \"tries\": %ld, \"commits\": %ld, \"conflicts\": %ld, "
+               "\"overflows\": %ld, \"explicits\": %ld, \"stops\": %ld, \"cycles\": %ld, "
+               "\"tm_cycles\": %ld, \"avg_lock_cycles\": %.1f, \"avg_tm_cycles\": %.1f, "
+               "\"commit_ratio\": %.4f, \"conflict_ratio\": %.4f, \"overflow_ratio\": %.4f, "
+               "\"explicit_ratio\": %.4f",
+            s->locks, s->tries, s->commits, s->conflicts, s->overflows, s->explicits,
+            s->stops, s->cycles, s->tm_cycles, ratio(s->cycles, s->locks),
+            ratio(s->tm_cycles, s->tries), ratio(s->commits, s->tries),
+            ratio(s->conflicts, s->tries), ratio(s->overflows, s->tries),
+            ratio(s->explicits, s->tries));
+}
 
-static int mcs_lock_tm(mcs_lock_t *lk) {
-  return mcs_lock_common(lk,false,true);
+static void csv_counts(FILE *f, const tm_stats_t *s) {
+    fprintf(f, "%d,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%.1f,%.1f,%.4f,%.4f,%.4f,%.4f",
+            s->threads, s->locks, s->tries, s->commits, s->conflicts, s->overflows,
+            s->explicits, s->stops, s->cycles, s->tm_cycles, ratio(s->cycles, s->locks),
+            ratio(s->tm_cycles, s->tries), ratio(s->commits, s->tries),
+            ratio(s->conflicts, s->tries), ratio(s->overflows, s->tries),
+            ratio(s->explicits, s->tries));
 }
 
+typedef struct {
+    FILE *f;
+    int n;
+} bucket_writer_t;
 
-static int mcs_trylock_tm(mcs_lock_t *lk) {
-  return mcs_lock_common(lk,true,true);
+static void json_bucket(void *arg, double upper_ns, int64_t count) {
+    bucket_writer_t *w = arg;
+    fprintf(w->f, "%s[%.1f, %ld]", w->n++ ? ", " : "", upper_ns, count);
 }
 
-static int mcs_unlock_tm(mcs_lock_t *lk) {
-  if(!spec_entry){return mcs_unlock_common(lk,true);}
-  else{return 0;}
+static void write_json(FILE *f, const tm_stats_t *sum, const tm_stats_t *threads, int num,
+                       int running, double seconds) {
+    fprintf(f, "{\n  \"pid\": %d,\n  \"seconds\": %.6f,\n", getpid(), seconds);
+    fprintf(f, "  \"config\": {\"lock\": ");
+    json_string(f, using_lock_type->name);
+    fprintf(f, ", \"rwlock\": ");
+    json_string(f, using_rwlock_type->name);
+    fprintf(f, ", \"stats\": \"%s\", \"num_tries\": %u, \"min_distance\": %u, "
+               "\"max_distance\": %u, \"cohort_batch\": %u, \"spin_init\": %d, "
+               "\"spin_cell\": %d, \"spin_factor\": %g, \"spin_park\": %d, "
+               "\"profile\": %d, \"tsc_per_ns\": %.4f},\n",
+            stats_levels[stats_level], TK_NUM_TRIES, TK_MIN_DISTANCE, TK_MAX_DISTANCE,
+            COHORT_BATCH, SPIN_INIT, SPIN_CELL, SPIN_FACTOR, SPIN_PARK, tl_profile_sample,
+            tl_tsc_per_ns);
+
+    fprintf(f, "  \"total\": {\"threads\": %d, ", sum->threads);
+    json_counts(f, sum);
+    fprintf(f, "},\n  \"threads_not_listed\": %d,\n  \"threads\": [", sum->threads - num);
+    for (int i=0; i<num; i++) {
+        fprintf(f, "%s\n    {\"tid\": %d, \"running\": %s, ", i ? "," : "", threads[i].tid,
+                i < running ? "true" : "false");
+        json_counts(f, &threads[i]);
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n  ],\n  \"phases\": [");
+    for (int i=0; i<num_phases; i++) {
+        fprintf(f, "%s\n    {\"name\": ", i ? "," : "");
+        json_string(f, phases[i].name);
+        fprintf(f, ", \"seconds\": %.6f, \"threads\": %d, ", phases[i].ns*1e-9,
+                phases[i].stats.threads);
+        json_counts(f, &phases[i].stats);
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n  ]");
+
+    tl_latency_t lat[2];
+    if (tl_latency_summary(lat)) {
+        const char *names[2] = {"wait", "hold"};
+        fprintf(f, ",\n  \"latency_ns\": {");
+        for (int w=0; w<2; w++) {
+            bucket_writer_t writer = {f, 0};
+            fprintf(f, "%s\n    \"%s\": {\"count\": %ld, \"p50\": %.1f, \"p90\": %.1f, "
+                       "\"p99\": %.1f, \"p99.9\": %.1f, \"max\": %.1f, \"buckets\": [",
+                    w ? "," : "", names[w], lat[w].count, lat[w].p50, lat[w].p90, lat[w].p99,
+                    lat[w].p999, lat[w].max);
+            tl_latency_buckets(w, json_bucket, &writer);
+            fprintf(f, "]}");
+        }
+        fprintf(f, "\n  }");
+    }
+    fprintf(f, "\n}\n");
 }
 
+// one table, each row starting with the configuration so that reports of
+// several runs can simply be concatenated
+static void write_csv(FILE *f, const tm_stats_t *sum, const tm_stats_t *threads, int num,
+                      int running, double seconds) {
+    char config[256];
+    snprintf(config, sizeof(config), "%s,%s,%s,%u,%u,%u,%u,%d,%d,%g,%d",
+             using_lock_type->name, using_rwlock_type->name, stats_levels[stats_level],
+             TK_NUM_TRIES, TK_MIN_DISTANCE, TK_MAX_DISTANCE, COHORT_BATCH, SPIN_INIT,
+             SPIN_CELL, SPIN_FACTOR, SPIN_PARK);
+
+    fprintf(f, "lock,rwlock,stats,num_tries,min_distance,max_distance,cohort_batch,"
+               "spin_init,spin_cell,spin_factor,spin_park,row,name,tid,seconds,threads,locks,"
+               "tries,commits,conflicts,overflows,explicits,stops,cycles,tm_cycles,"
+               "avg_lock_cycles,avg_tm_cycles,commit_ratio,conflict_ratio,overflow_ratio,"
+               "explicit_ratio,count,p50_ns,p90_ns,p99_ns,p99.9_ns,max_ns\n");
+    fprintf(f, "%s,total,,,%.6f,", config, seconds);
+    csv_counts(f, sum);
+    fprintf(f, ",,,,,,\n");
+    for (int i=0; i<num; i++) {
+        fprintf(f, "%s,thread,%s,%d,,", config, i < running ? "running" : "exited",
+                threads[i].tid);
+        csv_counts(f, &threads[i]);
+        fprintf(f, ",,,,,,\n");
+    }
+    for (int i=0; i<num_phases; i++) {
+        fprintf(f, "%s,phase,", config);
+        csv_string(f, phases[i].name);
+        fprintf(f, ",,%.6f,", phases[i].ns*1e-9);
+        csv_counts(f, &phases[i].stats);
+        fprintf(f, ",,,,,,\n");
+    }
+    tl_latency_t lat[2];
+    if (tl_latency_summary(lat)) {
+        const char *names[2] = {"wait", "hold"};
+        for (int w=0; w<2; w++)
+            fprintf(f, "%s,latency,%s,,,,,,,,,,,,,,,,,,%ld,%.1f,%.1f,%.1f,%.1f,%.1f\n", config,
+                    names[w], lat[w].count, lat[w].p50, lat[w].p90, lat[w].p99, lat[w].p999,
+                    lat[w].max);
+    }
+}
 
-// function dispatch =========================
-//
-
-struct _lock_type_t {
-    const char *name;
-    int lock_size;
-    txlock_func_t lock_fun;
-    txlock_func_t trylock_fun;
-    txlock_func_t unlock_fun;
-};
-typedef struct _lock_type_t lock_type_t;
-
-static lock_type_t lock_types[] = {
-    {"pthread",     sizeof(pthread_mutex_t), (txlock_func_t)pthread_lock, (txlock_func_t)pthread_trylock, (txlock_func_t)pthread_unlock},
-    {"pthread_tm",  sizeof(pthread_mutex_t), (txlock_func_t)pthread_lock_tm, (txlock_func_t)pthread_trylock_tm, (txlock_func_t)pthread_unlock_tm},
-    {"tas",         sizeof(tas_lock_t), (txlock_func_t)tas_lock, (txlock_func_t)tas_trylock, (txlock_func_t)tas_unlock},
-    {"tas_tm",      sizeof(tas_lock_t), (txlock_func_t)tas_lock_tm, (txlock_func_t)tas_trylock_tm, (txlock_func_t)tas_unlock_tm},
-    {"tas_priority_tm",      sizeof(tas_lock_t), (txlock_func_t)tas_priority_lock_tm, (txlock_func_t)tas_priority_trylock_tm, (txlock_func_t)tas_priority_unlock_tm},
-    {"tas_hle",     sizeof(tas_lock_t), (txlock_func_t)tas_lock_hle, (txlock_func_t)tas_trylock_hle, (txlock_func_t)tas_unlock_hle},
-    {"ticket",      sizeof(ticket_lock_t), (txlock_func_t)ticket_lock, (txlock_func_t)ticket_trylock, (txlock_func_t)ticket_unlock},
-    {"ticket_tm",   sizeof(ticket_lock_t), (txlock_func_t)ticket_lock_tm, (txlock_func_t)ticket_trylock_tm, (txlock_func_t)ticket_unlock_tm},
-    {"mcs",   sizeof(mcs_lock_t), (txlock_func_t)mcs_lock, (txlock_func_t)mcs_trylock, (txlock_func_t)mcs_unlock},
-    {"mcs_tm",   sizeof(mcs_lock_t), (txlock_func_t)mcs_lock_tm, (txlock_func_t)mcs_trylock_tm, (txlock_func_t)mcs_unlock_tm}
-};
-
-static lock_type_t *using_lock_type = &lock_types[2];
+static void write_report(const tm_stats_t *sum) {
+    if (!report_format)
+        return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double seconds = elapsed_ns(&report_start, &now)*1e-9;
+
+    // the running threads, then the exited ones
+    int num = 0, running = 0;
+    ul_lock(&stats_lock);
+    for (tm_stats_t* curr = tm_stats_head; curr; curr = curr->next)
+        num++;
+    tm_stats_t *threads = malloc((num + exited_logged)*sizeof(tm_stats_t));
+    if (threads) {
+        for (tm_stats_t* curr = tm_stats_head; curr; curr = curr->next) {
+            if (curr->tid != 0)
+                threads[running++] = *curr;
+        }
+        memcpy(threads + running, exited_log, exited_logged*sizeof(tm_stats_t));
+        num = running + exited_logged;
+    }
+    ul_unlock(&stats_lock);
+    if (!threads) {
+        perror("LIBTXLOCK_REPORT");
+        return;
+    }
+    for (int i=0; i<running; i++)
+        threads[i].threads = 1;
+
+    char tmp[PATH_MAX + 32];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", report_path, getpid());
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        perror(tmp);
+        free(threads);
+        return;
+    }
+    if (report_format == REPORT_JSON)
+        write_json(f, sum, threads, num, running, seconds);
+    else
+        write_csv(f, sum, threads, num, running, seconds);
+    if (fclose(f) != 0 || rename(tmp, report_path) != 0) {
+        perror(report_path);
+        unlink(tmp);
+    }
+    free(threads);
+}
 
 // Dynamically find the libpthread implementations
 // and store them before replacing them
@@ -713,6 +989,11 @@ static void setup_pthread_funcs() {
     libpthread_mutex_lock = (txlock_func_t)dlsym(handle, "pthread_mutex_lock");
     libpthread_mutex_trylock = (txlock_func_t)dlsym(handle, "pthread_mutex_trylock");
     libpthread_mutex_unlock = (txlock_func_t)dlsym(handle, "pthread_mutex_unlock");
+    libpthread_rwlock_rdlock = (txrwlock_func_t)dlsym(handle, "pthread_rwlock_rdlock");
+    libpthread_rwlock_wrlock = (txrwlock_func_t)dlsym(handle, "pthread_rwlock_wrlock");
+    libpthread_rwlock_tryrdlock = (txrwlock_func_t)dlsym(handle, "pthread_rwlock_tryrdlock");
+    libpthread_rwlock_trywrlock = (txrwlock_func_t)dlsym(handle, "pthread_rwlock_trywrlock");
+    libpthread_rwlock_unlock = (txrwlock_func_t)dlsym(handle, "pthread_rwlock_unlock");
 
     // and store them in the lock_types array
     //lock_types[0].lock_fun = libpthread_mutex_lock;
@@ -729,6 +1010,13 @@ static void setup_pthread_funcs() {
         fputs(error, stderr);
         exit(1);
     }
+
+    // older glibcs don't have the clock versions, leave them NULL
+    libpthread_rwlock_timedrdlock = (fun_pthread_rwlock_timed_t)dlsym(handle, "pthread_rwlock_timedrdlock");
+    libpthread_rwlock_timedwrlock = (fun_pthread_rwlock_timed_t)dlsym(handle, "pthread_rwlock_timedwrlock");
+    libpthread_rwlock_clockrdlock = (fun_pthread_rwlock_clock_t)dlsym(handle, "pthread_rwlock_clockrdlock");
+    libpthread_rwlock_clockwrlock = (fun_pthread_rwlock_clock_t)dlsym(handle, "pthread_rwlock_clockwrlock");
+    dlerror();
 }
 
 
@@ -747,29 +1035,65 @@ static void sig_term_handler(const int sig) {
     exit(-1);
 }
 
+// files built with different TXLOCK_TYPEs, or none defining which, would
+// take the same lock in different ways
+static void check_inline_types() {
+    for (const tl_inline_type_t *t = __start_tl_inline_types; t < __stop_tl_inline_types; t++) {
+        if (!tl_inline_lock_type) {
+            fprintf(stderr, "libtxlock: built with TXLOCK_TYPE=%s, but no file has "
+                            "TXLOCK_DEFINE_INLINE_TYPE\n", t->name);
+            abort();
+        }
+        if (strcmp(t->name, tl_inline_lock_type) != 0) {
+            fprintf(stderr, "libtxlock: files built with TXLOCK_TYPE=%s and %s\n",
+                    t->name, tl_inline_lock_type);
+            abort();
+        }
+    }
+}
+
 __attribute__((constructor(201)))  // after tl-pthread.so
 static void init_lib_txlock() {
     setup_pthread_funcs();
 
-		tm_stats_head = aligned_alloc(256, sizeof(tm_stats_t)); //calloc(1,sizeof(tm_stats_t));
-		memset(tm_stats_head, 0, sizeof(tm_stats_t));
-		my_tm_stats = tm_stats_head;
+    pthread_key_create(&mcs_nodes_key, release_thread_nodes);
+    mcs_nodes_key_ready = true;
+    if (my_numa_node >= 0)
+        pthread_setspecific(mcs_nodes_key, &my_free_nodes); // if it locked already
+    tl_numa_init();
 		
-    // determine lock type
-    const char *type = getenv("LIBTXLOCK_LOCK");
+    // determine lock type, the same way the tl_lock resolvers did
+    check_inline_types();
+    using_lock_type = lock_type_from_env();
+
+    open_shm_stats();
+    setup_report();
+    pthread_key_create(&stats_key, release_thread_stats);
+    stats_key_ready = true;
+    if (tl_thread_stats() != exited_stats)
+        pthread_setspecific(stats_key, my_tm_stats); // if it locked already
+
+    // and reader-writer lock type
+    rwlock_type_t *rwlock_types = rwlock_tables[stats_level];
+    using_rwlock_type = &rwlock_types[0];
+    const char *type = getenv("LIBTXLOCK_RWLOCK");
     if (type) {
-        for (size_t i=0; i<sizeof(lock_types)/sizeof(lock_type_t); i++) {
-            if (strcmp(type, lock_types[i].name) == 0) {
-                using_lock_type = &lock_types[i];
+        for (size_t i=0; i<TL_NUM_RWLOCK_TYPES; i++) {
+            if (strcmp(type, rwlock_types[i].name) == 0) {
+                using_rwlock_type = &rwlock_types[i];
                 break;
             }
         }
     }
 
     // set appropriate dispatching functions
-    func_tl_lock = using_lock_type->lock_fun;
-    func_tl_trylock = using_lock_type->trylock_fun;
-    func_tl_unlock = using_lock_type->unlock_fun;
+    seq_versioned = using_lock_type->lock_size <= TL_SEQ_OFFSET;
+    func_tl_rdlock = using_rwlock_type->rdlock_fun;
+    func_tl_wrlock = using_rwlock_type->wrlock_fun;
+    func_tl_tryrdlock = using_rwlock_type->tryrdlock_fun;
+    func_tl_trywrlock = using_rwlock_type->trywrlock_fun;
+    func_tl_rwunlock = using_rwlock_type->unlock_fun;
+    rwlock_is_pthread = using_rwlock_type == &rwlock_types[0];
 
     // read auxiliary arguments
     const char* env;
@@ -779,9 +1103,22 @@ static void init_lib_txlock() {
         TK_MIN_DISTANCE=atoi(env);
     if ((env = getenv("LIBTXLOCK_NUM_TRIES")) != NULL)
         TK_NUM_TRIES=atoi(env);
+    if ((env = getenv("LIBTXLOCK_HTM_READS")) != NULL)
+        TM_SEQ_READS=atoi(env);
+    if ((env = getenv("LIBTXLOCK_COHORT_BATCH")) != NULL)
+        COHORT_BATCH=atoi(env);
+    if ((env = getenv("LIBTXLOCK_PARK_SPIN")) != NULL)
+        SPIN_PARK=atoi(env);
+    else
+        calibrate_park_spin();
+    tl_profile_init();
 
       // notify user of arguments
     fprintf(stderr, "LIBTXLOCK_LOCK: %s\n", using_lock_type->name);
+    fprintf(stderr, "LIBTXLOCK_RWLOCK: %s\n", using_rwlock_type->name);
+    fprintf(stderr, "LIBTXLOCK_STATS: %s\n", stats_levels[stats_level]);
+    if (tl_profile_sample)
+        fprintf(stderr, "LIBTXLOCK_PROFILE: %d\n", tl_profile_sample);
     fflush(stderr);
 
     // register signal handlers just in case the default ones are active:
@@ -796,14 +1133,7 @@ typedef struct {
 } spawn_struct;
 
 void tl_thread_enter() {
-    if (my_tm_stats == 0) {
-        // push my stats onto the stack
-        my_tm_stats = aligned_alloc(256, sizeof(tm_stats_t)); //calloc(1,sizeof(tm_stats_t));
-        memset(my_tm_stats, 0, sizeof(tm_stats_t));
-        do {
-            my_tm_stats->next = tm_stats_head;
-        } while(!__sync_bool_compare_and_swap(&tm_stats_head, my_tm_stats->next, my_tm_stats));
-    }
+    tl_thread_stats();
 }
 
 int tl_in_spec() {
@@ -842,45 +1172,49 @@ int _tl_pthread_create(void *thread, const void *attr, void *(*start_routine) (v
 }
 
 
+// the rest of an exit report line
+static void print_counts(const tm_stats_t *s) {
+    if (s->locks!=0) {
+        fprintf(stderr, ", avg_lock_cycles: %ld, locks: %ld",
+                        (s->cycles/s->locks), s->locks);
+    }
+    if (s->tries!=0) {
+        fprintf(stderr, ", avg_tm_cycles: %ld, tm_tries: %ld, commits: %ld, overflows: %ld, conflicts: %ld, explicits: %ld, stops: %ld",
+                        (s->tm_cycles/s->tries), s->tries, s->commits,
+                        s->overflows, s->conflicts, s->explicits, s->stops);
+    }
+    fprintf(stderr, "\n");
+}
+
 __attribute__((destructor))
 static void uninit_lib_txlock()
 {
-    struct _tm_stats_t* volatile curr = tm_stats_head;
-    while (curr) {
-        tm_stats.cycles += curr->cycles;
-        tm_stats.tm_cycles += curr->tm_cycles;
-        tm_stats.locks += curr->locks;
-        tm_stats.tries += curr->tries;
-        tm_stats.stops += curr->stops;
-        tm_stats.commits += curr->commits;
-        tm_stats.overflows += curr->overflows;
-        tm_stats.conflicts += curr->conflicts;
-        tm_stats.threads += 1;
-        curr = curr->next;
-    }
-
+    tm_stats_t sum;
+    sum_stats(&sum);
+    tl_stats_phase(NULL);
 
     fprintf(stderr, "LIBTXLOCK_LOCK: %s", using_lock_type->name);
     fprintf(stderr, ", LIBTXLOCK_NUM_TRIES: %d, LIBTXLOCK_MIN_DISTANCE: %d, LIBTXLOCK_MAX_DISTANCE: %d", TK_NUM_TRIES, TK_MIN_DISTANCE, TK_MAX_DISTANCE);
-    if (tm_stats.threads==0) {
-        fprintf(stderr,"\nWARNING: No threads exited properly! Unable to gather profiling information.  \
-Ensure all threads properly terminate using pthread_exit()");
+    if (stats_level == 0) {
+        fprintf(stderr, "\nLIBTXLOCK stats off\n");
     }
     else{
-        fprintf(stderr, "\nLIBTXLOCK stats, threads %d",
-            tm_stats.threads);
-    }
-    if (tm_stats.locks!=0) {
-        fprintf(stderr, ", avg_lock_cycles: %ld, locks: %d",
-                        (tm_stats.cycles/tm_stats.locks), tm_stats.locks);
-    }
-    if (tm_stats.tries!=0) {
-        fprintf(stderr, ", avg_tm_cycles: %ld, tm_tries: %d, commits: %d, overflows: %d, conflicts: %d, stops: %d",
-                        (tm_stats.tm_cycles/tm_stats.tries), tm_stats.tries, tm_stats.commits,
-                        tm_stats.overflows, tm_stats.conflicts, tm_stats.stops);
+        fprintf(stderr, "\nLIBTXLOCK stats, threads %d", sum.threads);
+        print_counts(&sum);
+        for (int i=0; i<num_phases; i++) {
+            fprintf(stderr, "LIBTXLOCK phase %s, %.3fs, threads %d", phases[i].name,
+                    phases[i].ns*1e-9, phases[i].stats.threads);
+            print_counts(&phases[i].stats);
+        }
     }
-    fprintf(stderr, "\n");
     fflush(stderr);
+    tl_profile_report(0);
+    tl_latency_report();
+    write_report(&sum);
+
+    // threads may still be counting, so leave the mapping alone
+    if (shm_stats)
+        unlink(shm_path);
 
     if (libpthread_handle)
         dlclose(libpthread_handle);
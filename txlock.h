@@ -21,9 +21,80 @@ void tl_thread_enter();
 int tl_in_spec();
 void tl_stop_spec();
 
+// With TXLOCK_TYPE defined (tas, tas_tm, ticket or ticket_tm) these are
+// static inline, built at the call site from the same algorithms the
+// library uses. The library still picks its type at runtime otherwise.
+#ifndef TXLOCK_TYPE
 int tl_lock(txlock_t *l);
 int tl_trylock(txlock_t *l);
 int tl_unlock(txlock_t *l);
+#endif
+
+// Prints the top locks and call sites by contention to stderr, if the
+// process runs with LIBTXLOCK_PROFILE; top <= 0 for LIBTXLOCK_PROFILE_TOP.
+// It's also printed at exit.
+void tl_profile_report(int top);
+
+// Prints wait and hold time percentiles to stderr, if the process runs with
+// LIBTXLOCK_STATS=timing. It's also printed at exit.
+void tl_latency_report();
+
+// Lock statistics of the whole process. The cycles need LIBTXLOCK_STATS=timing,
+// and nothing is counted with LIBTXLOCK_STATS=off.
+struct tl_stats {
+    long long cycles;      // acquiring locks
+    long long tm_cycles;   // in transactions
+    long long locks;       // acquisitions of the lock itself
+    long long tries;       // transactions started
+    long long stops;       // tl_stop_spec aborts
+    long long commits;
+    long long overflows;   // capacity aborts
+    long long conflicts;
+    long long explicits;   // explicit aborts, stops included
+    int threads;           // running, and exited since the last reset
+};
+
+// Sums every thread's counters since the last tl_stats_reset, or since
+// startup. Safe while other threads keep locking.
+void tl_stats_snapshot(struct tl_stats *s);
+void tl_stats_reset();
+
+// Ends the current phase and starts one called name, or none if name is
+// NULL. Each phase's counts are printed at exit; the time before the first
+// phase isn't, so phases can leave out warmup.
+void tl_stats_phase(const char *name);
+
+// Optimistic (seqlock) reads. tl_lock/tl_unlock bump a version kept in the
+// slot, so readers never write the lock line:
+//
+//   tl_stamp_t s;
+//   do {
+//       s = tl_read_begin(l);
+//       ... read ...
+//   } while (!tl_read_validate(l, s));
+//
+// After repeated failures tl_read_begin takes the lock instead, and
+// tl_read_validate releases it. tl_read_to_write takes the lock for
+// writing, returning nonzero if what was read since s is still valid.
+typedef unsigned long long tl_stamp_t;
+
+tl_stamp_t tl_read_begin(txlock_t *l);
+int tl_read_validate(txlock_t *l, tl_stamp_t stamp);
+int tl_read_to_write(txlock_t *l, tl_stamp_t stamp);
+
+typedef struct{
+	// must be same size as pthreads for drop in replacement
+	char data[56];
+} txrwlock_t;
+
+int tl_rdlock(txrwlock_t *l);
+int tl_wrlock(txrwlock_t *l);
+int tl_tryrdlock(txrwlock_t *l);
+int tl_trywrlock(txrwlock_t *l);
+int tl_rwunlock(txrwlock_t *l);
+// abs_timeout is measured on clock, like pthread_rwlock_clock*lock()
+int tl_timedrdlock(txrwlock_t *l, clockid_t clock, const struct timespec *abs_timeout);
+int tl_timedwrlock(txrwlock_t *l, clockid_t clock, const struct timespec *abs_timeout);
 
 typedef struct{
 	// must be same size as pthreads for drop in replacement
@@ -39,4 +110,77 @@ int tc_broadcast(txcond_t* cv);
 }
 #endif
 
+#ifdef TXLOCK_TYPE
+#include "txlock_inline.h"
+
+#define TL_INLINE_ID_tas        1
+#define TL_INLINE_ID_tas_tm     2
+#define TL_INLINE_ID_ticket     3
+#define TL_INLINE_ID_ticket_tm  4
+#define TL_INLINE_ID_(t)        TL_INLINE_ID_##t
+#define TL_INLINE_ID(t)         TL_INLINE_ID_(t)
+#define TL_INLINE_STR_(t)       #t
+#define TL_INLINE_STR(t)        TL_INLINE_STR_(t)
+
+#if TL_INLINE_ID(TXLOCK_TYPE) == TL_INLINE_ID_tas
+    #define TL_INLINE_LOCK_T tas_lock_t
+    #define TL_INLINE_LOCK tas_lock
+    #define TL_INLINE_TRYLOCK tas_trylock
+    #define TL_INLINE_UNLOCK tas_unlock
+#elif TL_INLINE_ID(TXLOCK_TYPE) == TL_INLINE_ID_tas_tm
+    #define TL_INLINE_LOCK_T tas_lock_t
+    #define TL_INLINE_LOCK tas_lock_tm
+    #define TL_INLINE_TRYLOCK tas_trylock_tm
+    #define TL_INLINE_UNLOCK tas_unlock_tm
+#elif TL_INLINE_ID(TXLOCK_TYPE) == TL_INLINE_ID_ticket
+    #define TL_INLINE_LOCK_T ticket_lock_t
+    #define TL_INLINE_LOCK ticket_lock
+    #define TL_INLINE_TRYLOCK ticket_trylock
+    #define TL_INLINE_UNLOCK ticket_unlock
+#elif TL_INLINE_ID(TXLOCK_TYPE) == TL_INLINE_ID_ticket_tm
+    #define TL_INLINE_LOCK_T ticket_lock_t
+    #define TL_INLINE_LOCK ticket_lock_tm
+    #define TL_INLINE_TRYLOCK ticket_trylock_tm
+    #define TL_INLINE_UNLOCK ticket_unlock_tm
+#else
+    #error "TXLOCK_TYPE must be one of tas, tas_tm, ticket, ticket_tm"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Tells the library which type the inlined calls use, so that its own
+// locking (condition variables, optimistic reads) matches them. Exactly one
+// file of the program defines it, with `TXLOCK_DEFINE_INLINE_TYPE;`.
+extern const char tl_inline_lock_type[];
+#define TXLOCK_DEFINE_INLINE_TYPE \
+    const char tl_inline_lock_type[] = TL_INLINE_STR(TXLOCK_TYPE)
+
+// and what this file inlines, checked against it on load
+__attribute__((section("tl_inline_types"), used, aligned(16)))
+static const tl_inline_type_t tl_inline_type_here = {TL_INLINE_STR(TXLOCK_TYPE)};
+
+static inline int tl_lock(txlock_t *l) {
+    int ret = TL_INLINE_LOCK((TL_INLINE_LOCK_T*)l);
+    seq_write_begin(l);
+    return ret;
+}
+
+static inline int tl_trylock(txlock_t *l) {
+    int ret = TL_INLINE_TRYLOCK((TL_INLINE_LOCK_T*)l);
+    if (ret == 0) {seq_write_begin(l);}
+    return ret;
+}
+
+static inline int tl_unlock(txlock_t *l) {
+    seq_write_end(l);
+    return TL_INLINE_UNLOCK((TL_INLINE_LOCK_T*)l);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif // TXLOCK_TYPE
+
 #endif
@@ -0,0 +1,226 @@
+#ifndef _TXLOCK_HPP_
+#define _TXLOCK_HPP_
+
+// C++ mutexes put together at compile time from the txlock algorithms:
+//
+//   txlock::basic_mutex<WaitPolicy, QueuePolicy, SpecPolicy>
+//
+//   WaitPolicy:  spin, park<Budget>
+//   QueuePolicy: tas, ticket, mcs
+//   SpecPolicy:  no_spec, prefetch_htm<MinDistance, MaxDistance, Tries>
+//
+// They satisfy Lockable, so they work with std::lock_guard, std::unique_lock
+// and std::condition_variable_any. The policies only pick among the lock
+// algorithms of txlock_inline.h and txlock_internal.h, the ones the library's
+// lock types run, and pass them their tuning as template arguments rather
+// than the TK_* globals, so every instantiation is specialized and inlined.
+//
+// prefetch_htm speculates like the _tm lock types: a waiter close enough to
+// the head of the queue runs its critical section in a transaction that is
+// aborted when the lock changes hands, then takes the lock for real with the
+// data already in its cache. It needs -mrtm.
+//
+// Needs C++17, link with libtxlock.a (the MCS qnodes come from its pools).
+// Acquisitions aren't counted in the LIBTXLOCK stats, speculation attempts
+// are.
+
+#include <cstdint>
+#include <type_traits>
+
+#include "txlock_inline.h"
+#include "txlock_internal.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waddress-of-packed-member"
+
+namespace txlock {
+
+// wait policies =========================
+//
+
+// spin until the lock is ours
+struct spin {
+    static constexpr bool parks = false;
+    static constexpr int budget = 0;
+};
+
+// spin for Budget rounds, then sleep on a futex in the lock
+template<int Budget = 1024>
+struct park {
+    static_assert(Budget >= 0, "negative spin budget");
+    static constexpr bool parks = true;
+    static constexpr int budget = Budget;
+};
+
+
+// speculation policies =========================
+//
+
+struct no_spec {
+    static constexpr bool enabled = false;
+    static constexpr uint32_t min_distance = 0;
+    static constexpr uint32_t max_distance = 0;
+    static constexpr uint32_t tries = 0;
+};
+
+// speculate at most Tries times per acquisition, from the window the
+// matching _tm lock type uses for MinDistance and MaxDistance (the TK_*
+// defaults)
+template<uint32_t MinDistance = 0, uint32_t MaxDistance = 2, uint32_t Tries = 2>
+struct prefetch_htm {
+    static_assert(MinDistance <= MaxDistance, "empty speculation window");
+    static constexpr bool enabled = true;
+    static constexpr uint32_t min_distance = MinDistance;
+    static constexpr uint32_t max_distance = MaxDistance;
+    static constexpr uint32_t tries = Tries;
+};
+
+
+// test-and-set lock =========================
+//
+// tas, tas_tm, tas_park and tas_park_tm
+
+struct tas {
+    template<class W>
+    using state = tas_lock_t;
+
+    template<class W, class S>
+    static bool try_lock(tas_lock_t &l) {
+        if (S::enabled && spec_entry) {return true;}
+        if constexpr (W::parks) {return !tas_park_try(&l);}
+        return !tatas(&l.val, 1);
+    }
+
+    template<class W, class S>
+    static void lock(tas_lock_t &l) {
+        if (S::enabled && spec_entry) {return;}
+        if constexpr (W::parks && S::enabled) {
+            tas_park_acquire_tm(&l, S::tries, W::budget);
+        } else if constexpr (W::parks) {
+            if (tas_park_try(&l))
+                tas_park_slow(&l, W::budget);
+        } else if constexpr (S::enabled) {
+            tas_acquire_tm(&l, S::tries);
+        } else {
+            tas_acquire(&l);
+        }
+    }
+
+    template<class W, class S>
+    static void unlock(tas_lock_t &l) {
+        if (S::enabled && spec_entry) {return;}
+        if constexpr (W::parks) {
+            tas_park_release(&l);
+        } else {
+            __sync_lock_release(&l.val);
+        }
+    }
+};
+
+
+// ticket lock =========================
+//
+// ticket, ticket_tm, ticket_park and ticket_park_tm
+
+struct ticket {
+    template<class W>
+    using state = std::conditional_t<W::parks, ticket_park_lock_t, ticket_lock_t>;
+
+    template<class W, class S>
+    static bool try_lock(state<W> &l) {
+        if (S::enabled && spec_entry) {return true;}
+        return ticket_try_acquire((ticket_lock_t*)&l);
+    }
+
+    template<class W, class S>
+    static void lock(state<W> &l) {
+        if (S::enabled && spec_entry) {return;}
+        if constexpr (W::parks && S::enabled) {
+            ticket_park_acquire_tm(&l, S::tries, S::min_distance, S::max_distance, W::budget);
+        } else if constexpr (W::parks) {
+            ticket_park_acquire(&l, W::budget);
+        } else if constexpr (S::enabled) {
+            ticket_acquire_tm(&l, S::tries, S::min_distance, S::max_distance);
+        } else {
+            ticket_acquire(&l);
+        }
+    }
+
+    template<class W, class S>
+    static void unlock(state<W> &l) {
+        if (S::enabled && spec_entry) {return;}
+        if constexpr (W::parks) {
+            ticket_park_release(&l);
+        } else {
+            l.now = l.now + 1;
+        }
+    }
+};
+
+
+// queue lock =========================
+//
+// mcs, mcs_tm, mcs_park and mcs_park_tm, on the library's per-thread qnodes
+
+struct mcs {
+    template<class W>
+    using state = mcs_lock_t;
+
+    template<class W, class S>
+    static bool try_lock(mcs_lock_t &l) {
+        return mcs_acquire(&l, true, S::enabled, W::parks,
+                           S::min_distance, S::max_distance, W::budget) == 0;
+    }
+
+    template<class W, class S>
+    static void lock(mcs_lock_t &l) {
+        mcs_acquire(&l, false, S::enabled, W::parks,
+                    S::min_distance, S::max_distance, W::budget);
+    }
+
+    template<class W, class S>
+    static void unlock(mcs_lock_t &l) {
+        if (S::enabled && spec_entry) {return;}
+        mcs_release(&l, S::enabled, W::parks, S::min_distance, S::max_distance);
+    }
+};
+
+
+// the mutex =========================
+//
+
+template<class WaitPolicy, class QueuePolicy, class SpecPolicy = no_spec>
+class basic_mutex {
+public:
+    typedef WaitPolicy wait_policy;
+    typedef QueuePolicy queue_policy;
+    typedef SpecPolicy spec_policy;
+
+    basic_mutex() noexcept : state_() {}
+    basic_mutex(const basic_mutex&) = delete;
+    basic_mutex& operator=(const basic_mutex&) = delete;
+
+    void lock() {QueuePolicy::template lock<WaitPolicy, SpecPolicy>(state_);}
+    bool try_lock() {return QueuePolicy::template try_lock<WaitPolicy, SpecPolicy>(state_);}
+    void unlock() {QueuePolicy::template unlock<WaitPolicy, SpecPolicy>(state_);}
+
+private:
+    typename QueuePolicy::template state<WaitPolicy> state_;
+};
+
+// the library's lock types
+typedef basic_mutex<spin, tas>                       tas_mutex;
+typedef basic_mutex<spin, tas, prefetch_htm<>>       tas_tm_mutex;
+typedef basic_mutex<park<>, tas>                     tas_park_mutex;
+typedef basic_mutex<spin, ticket>                    ticket_mutex;
+typedef basic_mutex<spin, ticket, prefetch_htm<>>    ticket_tm_mutex;
+typedef basic_mutex<park<>, ticket>                  ticket_park_mutex;
+typedef basic_mutex<spin, mcs>                       mcs_mutex;
+typedef basic_mutex<spin, mcs, prefetch_htm<>>       mcs_tm_mutex;
+typedef basic_mutex<park<>, mcs>                     mcs_park_mutex;
+
+} // namespace txlock
+
+#pragma GCC diagnostic pop
+
+#endif
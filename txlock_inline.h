@@ -0,0 +1,282 @@
+#ifndef _TXLOCK_INLINE_H_
+#define _TXLOCK_INLINE_H_
+
+// Lock algorithms small enough to be inlined at the call site. txlock.c
+// builds its tas and ticket lock types from these, and txlock.h uses them
+// directly when TXLOCK_TYPE is defined, so both builds agree on what lives
+// where in a txlock_t. The _acquire functions don't count anything, so
+// txlock.hpp builds on them too.
+
+#include "txlock.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "txutil.h"
+
+// the lock words are packed, but always naturally aligned in the slot
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waddress-of-packed-member"
+
+// Seqlock version for optimistic readers, kept in the last bytes of the slot
+// where none of our lock types reach. Writers bump it to odd once they hold
+// the lock and back to even before they let go; speculating writers never
+// commit, so they leave it alone.
+#define TL_SEQ_OFFSET 36
+
+static inline volatile uint32_t* tl_seq(txlock_t *l) {
+    return (volatile uint32_t*)(l->data + TL_SEQ_OFFSET);
+}
+
+static inline void seq_write_begin(txlock_t *l) {
+    if (!spec_entry) {
+        *tl_seq(l) += 1;
+        __atomic_thread_fence(__ATOMIC_RELEASE); // version before the data
+    }
+}
+
+static inline void seq_write_end(txlock_t *l) {
+    if (!spec_entry) {
+        __atomic_thread_fence(__ATOMIC_RELEASE); // data before the version
+        *tl_seq(l) += 1;
+    }
+}
+
+// test-and-set lock =========================
+//
+struct _tas_lock_t {
+    union{
+        struct{
+            volatile int32_t val;
+            volatile int16_t ready;
+            volatile int16_t cnt;
+        };
+        volatile int64_t all;
+    };
+
+} __attribute__((__packed__));
+
+typedef struct _tas_lock_t tas_lock_t;
+
+static inline int tatas(volatile int32_t* val, int32_t v) {
+    return *val || __sync_lock_test_and_set(val, v);
+}
+
+static inline void tas_acquire(tas_lock_t *l) {
+    if (tatas(&l->val, 1)) {
+        int s = spin_begin();
+        do {
+            s = spin_wait(s);
+        } while (tatas(&l->val, 1));
+    }
+}
+
+static inline int tas_lock(tas_lock_t *l) {
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    tas_acquire(l);
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    return 0;
+}
+
+static inline int tas_trylock(tas_lock_t *l) {
+    if(tatas(&l->val, 1) == 0){
+        TM_STATS_ADD(MY_TM_STATS->locks, 1);
+        TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+        return 0;
+    }
+    return 1;
+}
+
+static inline int tas_unlock(tas_lock_t *l) {
+    __sync_lock_release(&l->val);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+    return 0;
+}
+
+
+// test-and-set TM lock =========================
+//
+
+// Takes l, or while it's held speculates on it up to num_tries times.
+// Returns true inside the transaction, which has read l so that the release
+// aborts it.
+static inline bool tas_acquire_tm(tas_lock_t *l, uint32_t num_tries) {
+  uint32_t tries = 0;
+  while (tatas(&l->val, 1)) {
+    // if lock is held, start speculating
+    if(tries<num_tries && enter_htm(l)==0){
+      if(l->val==0){HTM_ABORT(1);} // freed meanwhile
+      return true;
+    }
+    else{tries++;}
+    // fall to the lock if out of tries
+    if(tries>=num_tries){
+      int s = spin_begin();
+      while (tatas(&l->val, 1)){s = spin_wait(s);}
+      break;
+    }
+  }
+  return false;
+}
+
+static inline int tas_lock_tm(tas_lock_t *l) {
+  if (spec_entry == 0) { // not in HTM
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    if(tas_acquire_tm(l, TL_NUM_TRIES)){return 0;}
+  }
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static inline int tas_trylock_tm(tas_lock_t *l) {
+  if (spec_entry == 0) { // not in HTM
+    if(tatas(&l->val, 1)==0){
+      TM_STATS_ADD(MY_TM_STATS->locks, 1);
+      TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+      return 0;
+    }
+    else{return 1;}
+  }
+  return 0;
+}
+
+static inline int tas_unlock_tm(tas_lock_t *l) {
+  if (spec_entry) { // in htm
+  } else { // not in HTM
+    __sync_lock_release(&l->val);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  }
+  return 0;
+}
+
+// ticket lock =========================
+//
+
+struct _ticket_lock_t {
+  volatile uint32_t next;
+  volatile uint32_t now;
+} __attribute__((__packed__));
+
+typedef struct _ticket_lock_t ticket_lock_t;
+
+static inline bool ticket_try_acquire(ticket_lock_t *l) {
+    uint32_t now = l->now;
+    ticket_lock_t t = {now, now};
+    ticket_lock_t n = {now+1, now};
+    return __sync_bool_compare_and_swap((int64_t*)l, *(int64_t*)&t, *(int64_t*)&n);
+}
+
+static inline void ticket_acquire(ticket_lock_t *l) {
+    uint32_t my_ticket = __sync_fetch_and_add(&l->next, 1);
+    while (my_ticket != l->now) {
+        uint32_t dist = my_ticket - l->now;
+        spin_wait(16*dist);
+    }
+}
+
+static inline int ticket_lock(ticket_lock_t *l) {
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    ticket_acquire(l);
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    return 0;
+}
+
+static inline int ticket_trylock(ticket_lock_t *l) {
+    ticket_lock_t t, n;
+    t.now = t.next = l->now;
+    n.now = t.now;
+    n.next = t.next+1;
+
+    if((!(__sync_bool_compare_and_swap((int64_t*)l, *(int64_t*)&t, *(int64_t*)&n))) == 0){
+      TM_STATS_ADD(MY_TM_STATS->locks, 1);
+      TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+      return 0;
+    }
+    else{return 1;}
+}
+
+static inline int ticket_unlock(ticket_lock_t *l) {
+    l->now++;
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+    return 0;
+}
+
+// ticket lock TM =========================
+//
+//
+// whether a waiter dist tickets from the holder speculates
+static inline bool ticket_in_window(uint32_t dist, uint32_t min_distance, uint32_t max_distance) {
+    return dist <= max_distance && dist >= min_distance;
+}
+
+// Takes a ticket and waits for it, speculating up to num_tries times while
+// in the window. Returns true inside the transaction, which aborts when
+// our turn comes.
+static inline bool ticket_acquire_tm(ticket_lock_t *l, uint32_t num_tries,
+                                     uint32_t min_distance, uint32_t max_distance) {
+    uint32_t tries = 0;
+    uint32_t my_ticket = __sync_fetch_and_add(&l->next, 1);
+    while (my_ticket != l->now) {
+        uint32_t dist = my_ticket - l->now;
+        if (ticket_in_window(dist, min_distance, max_distance) && tries < num_tries) {
+            // if lock is held, start speculating
+            if(enter_htm(l)==0){
+                if(l->now==my_ticket){HTM_ABORT(1);}
+                return true;
+            }
+            else{
+                spin_wait(8);
+                tries++;
+            }
+        } else {
+            spin_wait(16*dist);
+        }
+    }
+    return false;
+}
+
+static inline int ticket_lock_tm(ticket_lock_t *l) {
+    if (spec_entry)
+        return 0;
+
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    if (ticket_acquire_tm(l, TL_NUM_TRIES, TL_MIN_DISTANCE, TL_MAX_DISTANCE))
+        return 0;
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    return 0;
+}
+
+static inline int ticket_trylock_tm(ticket_lock_t *l) {
+    if (spec_entry) { // in htm
+        return 0;
+    }
+    return ticket_trylock(l);
+}
+
+static inline int ticket_unlock_tm(ticket_lock_t *l) {
+    if (spec_entry) { // in htm
+       //if (spec_entry == l) {
+       // HTM_ABORT(7);
+       //}
+    } else { // not in HTM
+        l->now++;
+        TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+    }
+    return 0;
+}
+
+#pragma GCC diagnostic pop
+
+// Programs built with TXLOCK_TYPE leave one of these per file in the
+// tl_inline_types section, for the library to check on load that they all
+// inline the type it was told about
+typedef struct {
+    char name[16];
+} tl_inline_type_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
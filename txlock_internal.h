@@ -0,0 +1,496 @@
+#ifndef _TXLOCK_INTERNAL_H_
+#define _TXLOCK_INTERNAL_H_
+
+// Shared between txlock.c and txlock_types.c. txlock_types.c holds the lock
+// algorithms and is compiled once per stats level (TM_STATS_LEVEL in
+// txutil.h), giving a table of lock types per level; txlock.c picks one of
+// them on load from LIBTXLOCK_STATS. txlock.hpp builds its mutexes on the
+// futex helpers, qnodes and shared lock algorithms here.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "txlock.h"
+#include "txlock_inline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "txutil.h"
+
+// for the symbols shared between the two, so they stay out of the .so's
+// dynamic symbol table and bind locally (the IFUNC resolvers read the tables
+// before symbolic relocations are done)
+#define TL_INTERNAL __attribute__((visibility("hidden")))
+
+typedef int (*txlock_func_t)(txlock_t *);
+typedef int (*txlock_func_alloc_t)(txlock_t **);
+typedef int (*txrwlock_func_t)(txrwlock_t *);
+
+// Function pointers back into libpthreads implementations
+// (these are set on library load, in txlock.c)
+//typedef int (*fun_pthread_mutex_init_t)(pthread_mutex_t*, const pthread_mutexattr_t*);
+//static fun_pthread_mutex_init_t libpthread_mutex_init;
+TL_INTERNAL extern txlock_func_t libpthread_mutex_lock;
+TL_INTERNAL extern txlock_func_t libpthread_mutex_trylock;
+TL_INTERNAL extern txlock_func_t libpthread_mutex_unlock;
+TL_INTERNAL extern txrwlock_func_t libpthread_rwlock_rdlock;
+TL_INTERNAL extern txrwlock_func_t libpthread_rwlock_wrlock;
+TL_INTERNAL extern txrwlock_func_t libpthread_rwlock_tryrdlock;
+TL_INTERNAL extern txrwlock_func_t libpthread_rwlock_trywrlock;
+TL_INTERNAL extern txrwlock_func_t libpthread_rwlock_unlock;
+
+
+// futex helpers for the parking locks =======
+//
+// all of our locks live in process-private memory, so use the private ops
+
+static inline void futex_wait(volatile void *addr, int32_t val) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void futex_wake(volatile void *addr, int32_t nr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, nr, NULL, NULL, 0);
+}
+
+// only wakes the waiters whose bits overlap, so several wait queues can
+// share one word
+static inline void futex_wait_bits(volatile void *addr, int32_t val, uint32_t bits) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_BITSET_PRIVATE, val, NULL, NULL, bits);
+}
+
+static inline void futex_wake_bits(volatile void *addr, int32_t nr, uint32_t bits) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_BITSET_PRIVATE, nr, NULL, NULL, bits);
+}
+
+
+// queue lock qnodes =========================
+//
+// shared by the queue locks of all the tables
+
+struct _mcs_lock_t;
+
+// wait is a futex word for the parking variants: 1 while queued, 2 once
+// the owner has gone to sleep on it, 0 when the lock is handed over.
+// Every node gets its own cache line, so handing off or halting one
+// spinner never invalidates the line another spinner is polling.
+struct _mcs_node_t{
+  struct _mcs_node_t* volatile lock_next;
+  volatile int32_t wait;
+  volatile bool speculate;
+  int16_t socket;     // cna: node of the waiter, -1 if it never queued
+  union {
+    volatile uint64_t cnt;
+    volatile uintptr_t spin; // cna: 0 while waiting, else 1 or secondary queue head
+  };
+  struct _mcs_lock_t* lock;
+  struct _mcs_node_t* list_next;
+  struct _mcs_node_t* sec_tail; // cna: tail of the secondary queue, kept in its head
+  int home; // NUMA node the node's memory lives on
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+typedef struct _mcs_node_t mcs_node_t;
+
+// free qnodes of this thread, refilled by alloc_more_nodes (txlock.c)
+TL_INTERNAL extern __thread mcs_node_t* my_free_nodes;
+TL_INTERNAL void alloc_more_nodes();
+
+// head of the free list, it stays there until the caller pops it
+static inline mcs_node_t* peek_free_node(){
+  if(my_free_nodes == NULL){
+    alloc_more_nodes();
+    assert(my_free_nodes!=NULL);
+  }
+  return my_free_nodes;
+}
+
+static inline void dealloc_node(mcs_node_t* mine){
+  // put node back onto free list
+  mine->lock_next = NULL;
+  mine->list_next = my_free_nodes;
+  my_free_nodes = mine;
+}
+
+// zeroed, cache line aligned memory for per-lock side tables, from mmap'd
+// chunks since malloc may take a pthread mutex; never freed (txlock.c)
+TL_INTERNAL void* alloc_lock_lines(size_t size);
+
+
+// lock algorithms shared with txlock.hpp =========================
+//
+// The waiting parts of the parking and queue locks, with their tuning
+// passed in: txlock_types.c passes the TL_* settings, txlock.hpp its
+// template arguments. Nothing here counts acquisitions, the callers do.
+
+// test-and-set parking lock: val is 0 when free, 1 when held and 2 when
+// held with (possibly) sleeping waiters. Waiters spin for park_spin rounds
+// before they sleep on val, and the unlocker only pays for the wake syscall
+// when val says somebody might be asleep.
+
+static inline int tas_park_try(tas_lock_t *l) {
+    // cas rather than tatas, a blind swap could clobber a 2 with a 1
+    return l->val || !__sync_bool_compare_and_swap(&l->val, 0, 1);
+}
+
+static inline void tas_park_slow(tas_lock_t *l, int park_spin) {
+    int spun = 0;
+    int s = spin_begin();
+    while (spun < park_spin) {
+        if (!tas_park_try(l))
+            return;
+        spun += s;
+        s = spin_wait(s);
+    }
+    // out of budget, sleep until an unlocker hands the lock back
+    while (__sync_lock_test_and_set(&l->val, 2) != 0)
+        futex_wait(&l->val, 2);
+}
+
+static inline void tas_park_release(tas_lock_t *l) {
+    if (__sync_fetch_and_sub(&l->val, 1) != 1) {
+        __sync_lock_release(&l->val);
+        futex_wake(&l->val, 1);
+    }
+}
+
+// tas_park_slow, speculating up to num_tries times first; returns true
+// inside the transaction
+static inline bool tas_park_acquire_tm(tas_lock_t *l, uint32_t num_tries, int park_spin) {
+  uint32_t tries = 0;
+  while (tas_park_try(l)) {
+    // if lock is held, start speculating
+    if(tries<num_tries && enter_htm(l)==0){
+      if(l->val==0){HTM_ABORT(1);} // freed meanwhile
+      return true;
+    }
+    else{tries++;}
+    // fall to the parking lock if out of tries
+    if(tries>=num_tries){
+      tas_park_slow(l, park_spin);
+      break;
+    }
+  }
+  return false;
+}
+
+// ticket parking lock: same layout as ticket_lock_t (so ticket_trylock
+// works on it) plus a count of waiters asleep on now. A sleeper waits on
+// now under the bit for the ticket it wants to be woken at, and a release
+// only wakes the bit for the new value of now: the next holder, plus
+// whoever is 32 tickets behind it.
+
+struct _ticket_park_lock_t {
+  volatile uint32_t next;
+  volatile uint32_t now;
+  volatile int32_t parked;
+} __attribute__((__packed__));
+
+typedef struct _ticket_park_lock_t ticket_park_lock_t;
+
+static inline uint32_t ticket_bit(uint32_t ticket) {
+    return 1u << (ticket & 31);
+}
+
+static inline void ticket_park_sleep(ticket_park_lock_t *l, uint32_t seen, uint32_t wake_at) {
+    __sync_fetch_and_add(&l->parked, 1);
+    futex_wait_bits(&l->now, seen, ticket_bit(wake_at)); // returns at once if now already moved
+    __sync_fetch_and_sub(&l->parked, 1);
+}
+
+static inline void ticket_park_release(ticket_park_lock_t *l) {
+    uint32_t now = __sync_add_and_fetch(&l->now, 1);
+    if (l->parked)
+        futex_wake_bits(&l->now, INT_MAX, ticket_bit(now));
+}
+
+static inline void ticket_park_acquire(ticket_park_lock_t *l, int park_spin) {
+    int spun = 0;
+    uint32_t now;
+    uint32_t my_ticket = __sync_fetch_and_add(&l->next, 1);
+    while ((now = l->now) != my_ticket) {
+        uint32_t dist = my_ticket - now;
+        if (spun >= park_spin) {
+            ticket_park_sleep(l, now, my_ticket);
+        } else {
+            spin_wait(16*dist);
+            spun += 16*dist;
+        }
+    }
+}
+
+// ticket_acquire_tm that sleeps once it has spun park_spin, asking to be
+// woken in the window while it has tries left
+static inline bool ticket_park_acquire_tm(ticket_park_lock_t *l, uint32_t num_tries,
+                                          uint32_t min_distance, uint32_t max_distance,
+                                          int park_spin) {
+    uint32_t tries = 0;
+    int spun = 0;
+    uint32_t now;
+    uint32_t my_ticket = __sync_fetch_and_add(&l->next, 1);
+    while ((now = l->now) != my_ticket) {
+        uint32_t dist = my_ticket - now;
+        if (ticket_in_window(dist, min_distance, max_distance) && tries < num_tries) {
+            // if lock is held, start speculating
+            if(enter_htm(l)==0){
+                if(l->now==my_ticket){HTM_ABORT(1);}
+                return true;
+            }
+            else{
+                spin_wait(8);
+                tries++;
+            }
+        } else if (spun >= park_spin) {
+            // wake up in range to speculate while there are tries left
+            bool spec = tries < num_tries && dist > max_distance;
+            ticket_park_sleep(l, now, spec ? my_ticket - max_distance : my_ticket);
+        } else {
+            spin_wait(16*dist);
+            spun += 16*dist;
+        }
+    }
+    return false;
+}
+
+// queue lock
+
+// the holder parks its qnode in owner, so unlock finds it in O(1) no
+// matter how many other locks the thread holds
+struct _mcs_lock_t {
+  volatile mcs_node_t* tail;
+  volatile long now_serving;
+  mcs_node_t* owner;
+} __attribute__((__packed__));
+
+typedef struct _mcs_lock_t mcs_lock_t;
+
+// spin on my node, or for the parking variants, spin for park_spin rounds
+// and then sleep on it
+static inline void mcs_wait(mcs_node_t *mine, bool park, int park_spin) {
+  if (!park) {
+    while (mine->wait) {} // spin
+    return;
+  }
+  int spun = 0;
+  while (mine->wait) {
+    if (spun < park_spin) {
+      cpu_relax();
+      spun++;
+    } else if (__sync_val_compare_and_swap(&mine->wait, 1, 2) != 0) {
+      futex_wait(&mine->wait, 2);
+    }
+  }
+}
+
+static inline void mcs_wake(mcs_node_t *succ, bool park) {
+  if (!park) {
+    succ->wait = 0;
+  } else if (__sync_fetch_and_and(&succ->wait, 0) == 2) {
+    futex_wake(&succ->wait, 1);
+  }
+}
+
+// Queues up on lk, or only takes it if it's free with try_lock, and returns
+// 1 if it didn't. With tm, a waiter between min_distance and max_distance
+// from the holder speculates instead and returns 0 inside the transaction.
+static inline int mcs_acquire(mcs_lock_t *lk, bool try_lock, bool tm, bool park,
+                              uint32_t min_distance, uint32_t max_distance, int park_spin) {
+  if (spec_entry){return 0;}
+
+  // get a free node
+  mcs_node_t* mine = peek_free_node();
+
+  // init my qnode
+  mine->lock_next = NULL;
+  mine->lock = lk;
+  mine->wait = 1;
+  mine->speculate = true;
+  mine->cnt = 0;
+
+  // then swap it into the root pointer
+  mcs_node_t* pred = NULL;
+  if(try_lock){
+    if(!__sync_bool_compare_and_swap(&lk->tail, NULL, mine)){
+      return 1; // return failure
+    }
+  }
+  else{
+    pred = (mcs_node_t*)__sync_lock_test_and_set(&lk->tail, mine);
+  }
+
+  // we know we'll use the node, so take it off the free list
+  my_free_nodes = mine->list_next;
+  mine->list_next = NULL;
+
+  // now set my flag, point pred to me, and wait for my flag to be unset
+  if (pred != NULL) {
+    if(!tm){
+      pred->lock_next = mine;
+      __sync_synchronize(); // is this barrier needed?
+      mcs_wait(mine, park, park_spin);
+    }
+    else{
+      // finish enqueing
+      pred->lock_next = mine;
+      while(pred->cnt==0){} // wait for predecessor to get its count
+      __sync_synchronize(); // is this barrier needed?
+      long cnt = pred->cnt+1;
+      mine->cnt = cnt;
+      __sync_synchronize(); // is this barrier needed?
+
+      // decide whether to speculate
+      long now_serving_copy = lk->now_serving;
+      if(now_serving_copy<cnt-min_distance &&
+       now_serving_copy>cnt-max_distance &&
+       spec_entry==NULL){
+        spec_entry = lk;
+        if (HTM_SIMPLE_BEGIN() == HTM_SUCCESSFUL) {
+          if(mine->speculate!=true || mine->wait==0){
+            HTM_ABORT(0);
+          }
+          else{return 0;}
+        }
+        spec_entry=NULL;
+      }
+      // finished speculating
+
+      // actually acquire the lock
+      mcs_wait(mine, park, park_spin);
+      __sync_synchronize(); // is this barrier needed?
+      assert(lk->now_serving == cnt-1);
+      lk->now_serving = cnt;
+    }
+  }
+  else{
+    if(tm){
+      mine->cnt=lk->now_serving+1;
+      lk->now_serving++;
+    }
+  }
+
+  // only the holder writes owner, speculators returned above
+  lk->owner = mine;
+  return 0; // return success
+}
+
+// hands lk to the next in line, first halting its speculators with tm
+static inline int mcs_release(mcs_lock_t *lk, bool tm, bool park,
+                              uint32_t min_distance, uint32_t max_distance) {
+  mcs_node_t* mine = lk->owner;
+  assert(mine!=NULL && mine->lock==lk);
+
+  // if my node is the only one, then if I can zero the lock, do so and I'm
+  // done
+  if (mine->lock_next == NULL) {
+    if (__sync_bool_compare_and_swap(&lk->tail, mine, NULL)){
+      dealloc_node(mine);
+      return 0;
+    }
+    // uh-oh, someone arrived while I was zeroing... wait for arriver to
+    // initialize, fall out to other case
+    while (mine->lock_next == NULL) { } // spin
+  }
+
+  // halt speculators
+  if(tm){
+    mcs_node_t* current = mine->lock_next;
+    uint32_t dist = 1;
+    while(current!=NULL){
+      if(dist>=min_distance){
+        current->speculate = false;
+      }
+      if(dist>max_distance){break;}
+      current = current->lock_next;
+      dist++;
+    }
+  }
+  // wake spinners for speculation?????????
+
+
+  // if someone is waiting on me; set their flag to let them start
+  mcs_wake(mine->lock_next, park);
+
+  dealloc_node(mine);
+
+  return 0;
+}
+
+
+// lock type tables =========================
+//
+
+// Methods of each lock type, and the entry points tl_lock & co resolve to.
+// The pthread types fill the whole slot, so they go without the versioning.
+struct _lock_type_t {
+    const char *name;
+    int lock_size;
+    bool htm; // speculates, needs RTM
+    txlock_func_t lock_fun;
+    txlock_func_t trylock_fun;
+    txlock_func_t unlock_fun;
+    txlock_func_t tl_lock_fun;
+    txlock_func_t tl_trylock_fun;
+    txlock_func_t tl_unlock_fun;
+};
+typedef struct _lock_type_t lock_type_t;
+
+struct _rwlock_type_t {
+    const char *name;
+    int lock_size;
+    txrwlock_func_t rdlock_fun;
+    txrwlock_func_t wrlock_fun;
+    txrwlock_func_t tryrdlock_fun;
+    txrwlock_func_t trywrlock_fun;
+    txrwlock_func_t unlock_fun;
+};
+typedef struct _rwlock_type_t rwlock_type_t;
+
+// per-lock profile, call-site policies and latency histograms (txprofile.c):
+// with LIBTXLOCK_PROFILE=n, LIBTXLOCK_POLICY or LIBTXLOCK_STATS=timing,
+// tl_lock & co resolve to the _profiled wrappers around the entry points of
+// tl_profile_type, and tl_sited tells tl-pthread.c to pass its callers to
+// the _at versions
+TL_INTERNAL extern int tl_profile_sample; // one in n acquisitions, 0 is off
+TL_INTERNAL extern bool tl_timed;         // histograms of every acquisition
+TL_INTERNAL extern bool tl_sited;
+TL_INTERNAL extern lock_type_t *tl_profile_type;
+TL_INTERNAL void tl_profile_init();
+TL_INTERNAL int tl_lock_at(txlock_t *l, const void *site);
+TL_INTERNAL int tl_trylock_at(txlock_t *l, const void *site);
+TL_INTERNAL int tl_lock_profiled(txlock_t *l);
+TL_INTERNAL int tl_trylock_profiled(txlock_t *l);
+TL_INTERNAL int tl_unlock_profiled(txlock_t *l);
+
+// the merged latency histograms in ns, [0] wait and [1] hold, for the exit
+// report; false unless tl_timed. tl_latency_buckets passes fn each nonempty
+// bucket of one of them, with the highest value it holds.
+typedef struct {
+    int64_t count;
+    double p50, p90, p99, p999, max;
+} tl_latency_t;
+typedef void (*tl_latency_bucket_fn)(void *arg, double upper_ns, int64_t count);
+TL_INTERNAL bool tl_latency_summary(tl_latency_t lat[2]);
+TL_INTERNAL void tl_latency_buckets(int which, tl_latency_bucket_fn fn, void *arg);
+
+// one pair of tables per stats level, in the same order
+#define TL_NUM_LOCK_TYPES 21
+#define TL_NUM_RWLOCK_TYPES 4
+
+TL_INTERNAL extern lock_type_t lock_types_off[TL_NUM_LOCK_TYPES];
+TL_INTERNAL extern lock_type_t lock_types_counts[TL_NUM_LOCK_TYPES];
+TL_INTERNAL extern lock_type_t lock_types_timing[TL_NUM_LOCK_TYPES];
+TL_INTERNAL extern rwlock_type_t rwlock_types_off[TL_NUM_RWLOCK_TYPES];
+TL_INTERNAL extern rwlock_type_t rwlock_types_counts[TL_NUM_RWLOCK_TYPES];
+TL_INTERNAL extern rwlock_type_t rwlock_types_timing[TL_NUM_RWLOCK_TYPES];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1364 @@
+#define _GNU_SOURCE // for syscall()
+
+// The lock algorithms, and the tables of lock types built from them. This
+// file is compiled once per stats level, into txlock_types_off.o,
+// txlock_types_counts.o and txlock_types_timing.o, so the off tables have no
+// stats code at all.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include <pthread.h> // for pthread_mutex_t only
+
+#include <time.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <assert.h>
+#include <signal.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
+
+#include "txlock.h"
+#include "txutil.h"
+#include "txlock_inline.h"
+#include "txlock_internal.h"
+
+#if TM_STATS_LEVEL == 0
+#define TL_STATS_TABLE(name) name##_off
+#elif TM_STATS_LEVEL == 1
+#define TL_STATS_TABLE(name) name##_counts
+#else
+#define TL_STATS_TABLE(name) name##_timing
+#endif
+
+// Entry points wrapping a lock type's methods with the version bumps, for
+// the types that leave room for the version in the slot. These are what
+// tl_lock & co resolve to, so the methods get inlined into them.
+#define SEQ_ENTRY_POINTS(lock, trylock, unlock)     \
+    static int lock##_seq(txlock_t *l) {            \
+        int ret = lock((void*)l);                   \
+        seq_write_begin(l);                         \
+        return ret;                                 \
+    }                                               \
+    static int trylock##_seq(txlock_t *l) {         \
+        int ret = trylock((void*)l);                \
+        if (ret == 0) {seq_write_begin(l);}         \
+        return ret;                                 \
+    }                                               \
+    static int unlock##_seq(txlock_t *l) {          \
+        seq_write_end(l);                           \
+        return unlock((void*)l);                    \
+    }
+
+
+// test-and-set TM lock =========================
+//
+
+static int tas_lock_hle(tas_lock_t *l) {
+  int tries = 0;
+  int s = spin_begin();
+
+  while (enter_htm(0)) {
+    tries++;
+
+    if(tries>=TL_NUM_TRIES){
+      TM_STATS_ADD(MY_TM_STATS->locks, 1);
+      while (tatas(&l->val, 1)){s = spin_wait(s);}
+      break;
+    } else {
+      s = spin_wait(s);
+    }
+  }
+
+  // locked by other thread, waiting for abort
+  if (HTM_IS_ACTIVE() && (l->val==1)) {
+    while (1)
+     spin_wait(spin_begin());
+  }
+
+  return 0;
+}
+
+static int tas_trylock_hle(tas_lock_t *l) {
+  // elide once like tas_lock_hle, but don't wait when it's taken
+  if (enter_htm(0) == 0) {
+    if (l->val == 0) {return 0;} // tas_unlock_hle commits
+    HTM_END();
+    return 1;
+  }
+  if (tatas(&l->val, 1) == 0) {
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    return 0;
+  }
+  return 1;
+}
+
+static int tas_unlock_hle(tas_lock_t *l) {
+  if (HTM_IS_ACTIVE()) { // in htm
+    HTM_END();
+    TM_STATS_ADD(MY_TM_STATS->commits, 1);
+  } else { // not in HTM
+    __sync_lock_release(&l->val);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  }
+  return 0;
+}
+
+
+// tas priority lock =========================
+//
+
+static int tas_priority_lock_tm(tas_lock_t *lk) {
+  int tries = 0;
+  if (spec_entry == 0) { // not in HTM
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    tas_lock_t copy;
+    int s = spin_begin();
+    while(true){
+			copy.all = lk->all;
+			if(copy.ready==0){
+					if (!tatas(&lk->val, 1)) {
+							break;
+					}
+			}
+			if(copy.ready + TL_MIN_DISTANCE < TL_MAX_DISTANCE){
+				if(enter_htm(lk)==0){
+					//if(lk->val!=1){HTM_ABORT(1);}
+					return 0;
+				}
+				else{
+					__sync_fetch_and_add(&lk->ready,1);
+					while (tatas(&lk->val, 1)){}
+					__sync_fetch_and_add(&lk->ready,-1);
+					break;
+				}
+			}
+			/*
+			if(copy.cnt < TK_MAX_DISTANCE-TK_MIN_DISTANCE){
+				bool tmp = __sync_bool_compare_and_swap(&lk->cnt,copy.cnt,copy.cnt+1);
+				//if(tmp == 0){}
+				//else 
+					if(enter_htm(lk)==0){
+					//if(lk->val!=1){HTM_ABORT(1);}
+					return 0;
+				}
+				else{
+					//__sync_fetch_and_add(&lk->cnt,-1);
+					__sync_fetch_and_add(&lk->ready,1);
+					s = spin_begin();
+					while (tatas(&lk->val, 1)){s = spin_wait(s);}
+					__sync_fetch_and_add(&lk->ready,-1);
+					break;
+				}
+			}*/
+			/*
+			if(copy.cnt < TK_MAX_DISTANCE-TK_MIN_DISTANCE){
+				lk->cnt=1;
+				if(enter_htm(lk)==0){
+					return 0;
+				}
+				else{
+					lk->ready=1;
+					lk->cnt=0;
+					while (tatas(&lk->val, 1)){if(lk->ready!=1){lk->ready=1;}}
+					lk->ready=0;
+					break;
+				}
+			}*/
+			s = spin_wait(s);
+    }
+  }
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int tas_priority_trylock_tm(tas_lock_t *lk) {
+  if (spec_entry == 0) { // not in HTM
+    tas_lock_t copy;
+    copy.all = lk->all;
+    if(copy.ready==0 && (tatas(&lk->val, 1)==0)){
+      TM_STATS_ADD(MY_TM_STATS->locks, 1);
+      TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+      return 0;
+    }
+    else{return 1;}
+  }
+  return 0;
+}
+
+static int tas_priority_unlock_tm(tas_lock_t *l) {
+  if (spec_entry == 0) { // not in HTM
+    __sync_lock_release(&l->val);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  }
+  return 0;
+}
+
+// test-and-set parking lock =========================
+//
+// on the tas_park_* helpers in txlock_internal.h
+
+static int tas_park_lock(tas_lock_t *l) {
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    if (tas_park_try(l))
+        tas_park_slow(l, TL_PARK_SPIN);
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    return 0;
+}
+
+static int tas_park_trylock(tas_lock_t *l) {
+    if(tas_park_try(l) == 0){
+        TM_STATS_ADD(MY_TM_STATS->locks, 1);
+        TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+        return 0;
+    }
+    return 1;
+}
+
+static int tas_park_unlock(tas_lock_t *l) {
+    tas_park_release(l);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+    return 0;
+}
+
+// test-and-set parking TM lock =========================
+//
+
+static int tas_park_lock_tm(tas_lock_t *l) {
+  if (spec_entry == 0) { // not in HTM
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    if(tas_park_acquire_tm(l, TL_NUM_TRIES, TL_PARK_SPIN)){return 0;}
+  }
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int tas_park_trylock_tm(tas_lock_t *l) {
+  if (spec_entry == 0) { // not in HTM
+    return tas_park_trylock(l);
+  }
+  return 0;
+}
+
+static int tas_park_unlock_tm(tas_lock_t *l) {
+  if (spec_entry) { // in htm
+  } else { // not in HTM
+    tas_park_release(l);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  }
+  return 0;
+}
+
+// ticket parking lock =========================
+//
+// on the ticket_park_* helpers in txlock_internal.h; the TM variant asks to
+// be woken when it is close enough to speculate
+
+static int ticket_park_lock(ticket_park_lock_t *l) {
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    ticket_park_acquire(l, TL_PARK_SPIN);
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    return 0;
+}
+
+static int ticket_park_trylock(ticket_park_lock_t *l) {
+    return ticket_trylock((ticket_lock_t*)l);
+}
+
+static int ticket_park_unlock(ticket_park_lock_t *l) {
+    ticket_park_release(l);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+    return 0;
+}
+
+// ticket parking lock TM =========================
+//
+
+static int ticket_park_lock_tm(ticket_park_lock_t *l) {
+    if (spec_entry)
+        return 0;
+
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    if (ticket_park_acquire_tm(l, TL_NUM_TRIES, TL_MIN_DISTANCE, TL_MAX_DISTANCE, TL_PARK_SPIN))
+        return 0;
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    return 0;
+}
+
+static int ticket_park_trylock_tm(ticket_park_lock_t *l) {
+    if (spec_entry) { // in htm
+        return 0;
+    }
+    return ticket_park_trylock(l);
+}
+
+static int ticket_park_unlock_tm(ticket_park_lock_t *l) {
+    if (spec_entry) { // in htm
+    } else { // not in HTM
+        ticket_park_release(l);
+        TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+    }
+    return 0;
+}
+
+
+// pthreads =====================
+//
+
+static int pthread_lock(void *lk){
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    int retval = libpthread_mutex_lock(lk);
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    return retval;
+}
+static int pthread_trylock(void *lk){
+    int retval = libpthread_mutex_trylock(lk);
+    if(retval==0){
+        TM_STATS_ADD(MY_TM_STATS->locks, 1);
+        TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    }
+    return retval;
+}
+static int pthread_unlock(void *lk){
+    int retval = libpthread_mutex_unlock(lk);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+    return retval;
+}
+
+
+// pthreads TM =========================
+//
+
+static int pthread_lock_tm(pthread_mutex_t *l) {
+  if (spec_entry){return 0;}
+
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  int tries = 0;
+  while (libpthread_mutex_trylock((void*)l) != 0) {
+    if(tries<TL_NUM_TRIES && enter_htm(l)==0){return 0;}
+    else{tries++;}
+
+    if(tries>=TL_NUM_TRIES){
+        libpthread_mutex_lock((void*)l);
+        break;
+    }
+  }
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int pthread_trylock_tm(pthread_mutex_t *l) {
+    if (spec_entry) { // in htm
+        // nothing
+        return 0;
+    } else { // not in HTM
+        int retval = libpthread_mutex_trylock((void*)l);
+        if(retval==0){
+            TM_STATS_ADD(MY_TM_STATS->locks, 1);
+            TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+        }
+        return retval;
+    }
+}
+
+static int pthread_unlock_tm(pthread_mutex_t *l) {
+    if (spec_entry) { // in htm
+       //if (spec_entry == l) {
+       // HTM_ABORT(7);
+       //}
+    } else { // not in HTM
+        libpthread_mutex_unlock((void*)l);
+        TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+    }
+    return 0;
+}
+
+
+
+// queue lock ================================
+//
+// on mcs_acquire and mcs_release in txlock_internal.h
+
+static inline int mcs_lock_common(mcs_lock_t *lk, bool try_lock, bool tm, bool park) {
+  return mcs_acquire(lk, try_lock, tm, park, tm ? TL_MIN_DISTANCE : 0, tm ? TL_MAX_DISTANCE : 0,
+                     park ? TL_PARK_SPIN : 0);
+}
+
+static inline int mcs_unlock_common(mcs_lock_t *lk, bool tm, bool park) {
+  return mcs_release(lk, tm, park, tm ? TL_MIN_DISTANCE : 0, tm ? TL_MAX_DISTANCE : 0);
+}
+
+static int mcs_lock(mcs_lock_t *lk) {
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  mcs_lock_common(lk,false,false,false);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+
+static int mcs_trylock(mcs_lock_t *lk) {
+  if (mcs_lock_common(lk,true,false,false))
+    return 1;
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+
+
+static int mcs_unlock(mcs_lock_t *lk) {
+  mcs_unlock_common(lk,false,false);
+  TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+
+static int mcs_lock_tm(mcs_lock_t *lk) {
+  if (spec_entry){return 0;}
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  mcs_lock_common(lk,false,true,false);
+  if (!spec_entry) // took it rather than speculating
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+
+static int mcs_trylock_tm(mcs_lock_t *lk) {
+  if (spec_entry){return 0;}
+  if (mcs_lock_common(lk,true,true,false))
+    return 1;
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int mcs_unlock_tm(mcs_lock_t *lk) {
+  if(!spec_entry){
+    mcs_unlock_common(lk,true,false);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  }
+  return 0;
+}
+
+
+// queue parking lock ================================
+//
+
+static int mcs_park_lock(mcs_lock_t *lk) {
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  mcs_lock_common(lk,false,false,true);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int mcs_park_trylock(mcs_lock_t *lk) {
+  if (mcs_lock_common(lk,true,false,true))
+    return 1;
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int mcs_park_unlock(mcs_lock_t *lk) {
+  mcs_unlock_common(lk,false,true);
+  TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int mcs_park_lock_tm(mcs_lock_t *lk) {
+  if (spec_entry){return 0;}
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  mcs_lock_common(lk,false,true,true);
+  if (!spec_entry) // took it rather than speculating
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int mcs_park_trylock_tm(mcs_lock_t *lk) {
+  if (spec_entry){return 0;}
+  if (mcs_lock_common(lk,true,true,true))
+    return 1;
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int mcs_park_unlock_tm(mcs_lock_t *lk) {
+  if(!spec_entry){
+    mcs_unlock_common(lk,true,true);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  }
+  return 0;
+}
+
+
+// CLH queue lock ================================
+//
+// Borrows the MCS qnodes and their pools: wait doubles as CLH's locked flag.
+// A waiter spins on its predecessor's node and, once it has the lock, takes
+// that node over as its own spare; its own node goes to its successor.
+
+struct _clh_lock_t {
+  volatile mcs_node_t* tail;
+  volatile long now_serving;
+  mcs_node_t* owner;
+} __attribute__((__packed__));
+
+typedef struct _clh_lock_t clh_lock_t;
+
+static int inline clh_lock_common(clh_lock_t *lk, bool try_lock, bool tm) {
+  if (spec_entry){return 0;}
+
+  mcs_node_t* mine = peek_free_node();
+  mine->lock = (void*)lk;
+  mine->wait = 1;
+  mine->cnt = 0;
+
+  // swap my node into the tail
+  mcs_node_t* pred = NULL;
+  if(try_lock){
+    if(!__sync_bool_compare_and_swap(&lk->tail, NULL, mine)){
+      return 1; // return failure
+    }
+  }
+  else{
+    pred = (mcs_node_t*)__sync_lock_test_and_set(&lk->tail, mine);
+  }
+  my_free_nodes = mine->list_next;
+  mine->list_next = NULL;
+
+  if (pred != NULL) {
+    if(!tm){
+      while (pred->wait) {} // spin on predecessor
+    }
+    else{
+      while(pred->cnt==0){} // wait for predecessor to get its count
+      long cnt = pred->cnt+1;
+      mine->cnt = cnt;
+      __sync_synchronize();
+
+      // decide whether to speculate, same rule as mcs_lock_tm
+      long now_serving_copy = lk->now_serving;
+      if(now_serving_copy<cnt-TL_MIN_DISTANCE &&
+       now_serving_copy>cnt-TL_MAX_DISTANCE &&
+       spec_entry==NULL){
+        spec_entry = lk;
+        if (HTM_SIMPLE_BEGIN() == HTM_SUCCESSFUL) {
+          // reading pred's flag subscribes us to it, so the handoff to us
+          // aborts the speculation
+          if(pred->wait==0){
+            HTM_ABORT(0);
+          }
+          else{return 0;}
+        }
+        spec_entry=NULL;
+      }
+      // finished speculating
+
+      // actually acquire the lock
+      while (pred->wait) {}
+      __sync_synchronize();
+      assert(lk->now_serving == cnt-1);
+      lk->now_serving = cnt;
+    }
+    // nobody else can see pred any more, keep it as a spare
+    dealloc_node(pred);
+  }
+  else{
+    if(tm){
+      mine->cnt=lk->now_serving+1;
+      lk->now_serving++;
+    }
+  }
+
+  lk->owner = mine;
+  return 0; // return success
+}
+
+static inline int clh_unlock_common(clh_lock_t *lk) {
+  mcs_node_t* mine = lk->owner;
+  assert(mine!=NULL && mine->lock==(void*)lk);
+
+  // nobody queued behind me, empty the lock and keep my node
+  if (lk->tail == mine && __sync_bool_compare_and_swap(&lk->tail, mine, NULL)) {
+    dealloc_node(mine);
+    return 0;
+  }
+
+  // otherwise my node now belongs to my successor
+  __sync_synchronize();
+  mine->wait = 0;
+  return 0;
+}
+
+static int clh_lock(clh_lock_t *lk) {
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  clh_lock_common(lk,false,false);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int clh_trylock(clh_lock_t *lk) {
+  if (clh_lock_common(lk,true,false))
+    return 1;
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int clh_unlock(clh_lock_t *lk) {
+  clh_unlock_common(lk);
+  TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int clh_lock_tm(clh_lock_t *lk) {
+  if (spec_entry){return 0;}
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  clh_lock_common(lk,false,true);
+  if (!spec_entry) // took it rather than speculating
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int clh_trylock_tm(clh_lock_t *lk) {
+  if (spec_entry){return 0;}
+  if (clh_lock_common(lk,true,true))
+    return 1;
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int clh_unlock_tm(clh_lock_t *lk) {
+  if(!spec_entry){
+    clh_unlock_common(lk);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  }
+  return 0;
+}
+
+
+// NUMA cohort lock (C-TKT-MCS) ================================
+//
+// A global ticket lock plus one local MCS lock per NUMA node. The holder
+// hands the global lock to a waiter on its own node, through the local
+// lock, up to COHORT_BATCH times in a row before releasing it to the other
+// nodes. The per-node state doesn't fit in the slot, so each lock gets an
+// out-of-line table of it on first use. pthread_mutex_destroy isn't
+// interposed, so the table is never reclaimed: a process that keeps
+// creating cohort mutexes leaks tl_numa_nodes cache lines per mutex.
+
+typedef struct {
+  mcs_lock_t lk;
+  volatile int32_t waiting;     // threads queued on lk, for the TM variant
+  int32_t batch;                // consecutive local handoffs
+  volatile bool global_passed;  // the next local holder inherits the global lock
+} __attribute__((aligned(CACHE_LINE_SIZE))) cohort_local_t;
+
+struct _cohort_lock_t {
+  ticket_lock_t global;
+  cohort_local_t* volatile locals;
+  volatile int32_t owner_node;
+} __attribute__((__packed__));
+
+typedef struct _cohort_lock_t cohort_lock_t;
+
+static inline cohort_local_t* cohort_locals(cohort_lock_t *lk) {
+  cohort_local_t* locals = lk->locals;
+  if (locals == NULL) {
+    // not malloc, which may take a pthread mutex and land back here
+    locals = alloc_lock_lines(tl_numa_nodes * sizeof(cohort_local_t));
+    if (!__sync_bool_compare_and_swap(&lk->locals, NULL, locals)) {
+      locals = lk->locals; // lost the race to another first user, its table is wasted
+    }
+  }
+  return locals;
+}
+
+static inline bool cohort_held(cohort_lock_t *lk) {
+  return lk->global.now != lk->global.next;
+}
+
+static inline void cohort_acquire(cohort_lock_t *lk, cohort_local_t* local, int node, bool tm) {
+  if (tm) {__sync_fetch_and_add(&local->waiting, 1);}
+  mcs_lock_common(&local->lk,false,false,false);
+  if (tm) {__sync_fetch_and_sub(&local->waiting, 1);}
+
+  if (local->global_passed) {
+    local->global_passed = false;
+  } else {
+    ticket_acquire(&lk->global);
+  }
+  lk->owner_node = node;
+}
+
+static inline void cohort_release(cohort_lock_t *lk) {
+  cohort_local_t* local = &lk->locals[lk->owner_node];
+  mcs_node_t* mine = local->lk.owner;
+
+  // keep the global lock on this node while there are local waiters and
+  // budget left, otherwise give the other nodes a turn
+  bool waiters = mine->lock_next != NULL || local->lk.tail != mine;
+  if (waiters && local->batch < COHORT_BATCH) {
+    local->batch++;
+    local->global_passed = true;
+  } else {
+    local->batch = 0;
+    lk->global.now++;
+  }
+  mcs_unlock_common(&local->lk,false,false);
+}
+
+static int cohort_lock(cohort_lock_t *lk) {
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  int node = tl_numa_node();
+  cohort_acquire(lk, &cohort_locals(lk)[node], node, false);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int cohort_trylock(cohort_lock_t *lk) {
+  int node = tl_numa_node();
+  cohort_local_t* local = &cohort_locals(lk)[node];
+
+  // a free local lock never has a global lock waiting to be inherited
+  if (mcs_lock_common(&local->lk,true,false,false) != 0) {
+    return 1;
+  }
+  if (!ticket_try_acquire(&lk->global)) {
+    mcs_unlock_common(&local->lk,false,false);
+    return 1;
+  }
+  lk->owner_node = node;
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int cohort_unlock(cohort_lock_t *lk) {
+  cohort_release(lk);
+  TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+// NUMA cohort lock TM ================================
+//
+// Only waiters on the holder's node speculate, since that's where the
+// holder is pulling the protected data to. Their distance is their place
+// in the local queue, with the holder at distance 1.
+
+static int cohort_lock_tm(cohort_lock_t *lk) {
+  if (spec_entry){return 0;}
+
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  int node = tl_numa_node();
+  cohort_local_t* local = &cohort_locals(lk)[node];
+  uint32_t tries = 0;
+  while (tries < TL_NUM_TRIES && cohort_held(lk) && lk->owner_node == node) {
+    uint32_t dist = local->waiting + 1;
+    if (dist < TL_MIN_DISTANCE || dist > TL_MAX_DISTANCE) {
+      break;
+    }
+    if(enter_htm(lk)==0){
+      // read what every handoff writes, so the release aborts us: global.now
+      // when it leaves the node, global_passed and owner_node when it stays
+      if(!cohort_held(lk) || lk->owner_node != node || local->global_passed){HTM_ABORT(1);}
+      return 0;
+    }
+    else{tries++;}
+  }
+  cohort_acquire(lk, local, node, true);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int cohort_trylock_tm(cohort_lock_t *lk) {
+  if (spec_entry) { // in htm
+    return 0;
+  }
+  return cohort_trylock(lk);
+}
+
+static int cohort_unlock_tm(cohort_lock_t *lk) {
+  if (spec_entry) { // in htm
+  } else { // not in HTM
+    cohort_release(lk);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  }
+  return 0;
+}
+
+
+// compact NUMA-aware queue lock (CNA) ================================
+//
+// An MCS lock that needs nothing outside the slot. At unlock time the
+// holder looks down the queue for a waiter on its own node, moving the
+// remote waiters it skips over to a secondary queue whose head it passes
+// along in spin. After COHORT_BATCH consecutive local handoffs, or when no
+// local waiter is left, the secondary queue is spliced back in front.
+
+struct _cna_lock_t {
+  volatile mcs_node_t* tail;
+  mcs_node_t* owner;
+  uint32_t handoffs; // consecutive handoffs within a node
+} __attribute__((__packed__));
+
+typedef struct _cna_lock_t cna_lock_t;
+
+static int inline cna_lock_common(cna_lock_t *lk, bool try_lock) {
+  mcs_node_t* mine = peek_free_node();
+  mine->lock_next = NULL;
+  mine->lock = (void*)lk;
+  mine->spin = 0;
+  mine->socket = -1;
+
+  // swap my node into the tail
+  mcs_node_t* pred = NULL;
+  if(try_lock){
+    if(!__sync_bool_compare_and_swap(&lk->tail, NULL, mine)){
+      return 1; // return failure
+    }
+  }
+  else{
+    pred = (mcs_node_t*)__sync_lock_test_and_set(&lk->tail, mine);
+  }
+  my_free_nodes = mine->list_next;
+  mine->list_next = NULL;
+
+  if (pred == NULL) {
+    mine->spin = 1;
+  } else {
+    // the unlocker sorts waiters by socket, so publish it before linking in
+    mine->socket = tl_numa_node();
+    __sync_synchronize();
+    pred->lock_next = mine;
+    while (mine->spin == 0) {} // spin
+  }
+
+  lk->owner = mine;
+  return 0;
+}
+
+// find a waiter on my node, moving the ones skipped on the way to the
+// secondary queue
+static mcs_node_t* cna_find_successor(mcs_node_t* mine) {
+  mcs_node_t* next = mine->lock_next;
+  int my_socket = mine->socket;
+  if (my_socket == -1) {my_socket = tl_numa_node();}
+  if (next->socket == my_socket) {return next;}
+
+  mcs_node_t* sec_head = next;
+  mcs_node_t* sec_tail = next;
+  mcs_node_t* current = next->lock_next;
+  while (current != NULL) {
+    if (current->socket == my_socket) {
+      if (mine->spin > 1) {
+        ((mcs_node_t*)mine->spin)->sec_tail->lock_next = sec_head;
+      } else {
+        mine->spin = (uintptr_t)sec_head;
+      }
+      sec_tail->lock_next = NULL;
+      ((mcs_node_t*)mine->spin)->sec_tail = sec_tail;
+      return current;
+    }
+    sec_tail = current;
+    current = current->lock_next;
+  }
+  return NULL;
+}
+
+static inline int cna_unlock_common(cna_lock_t *lk) {
+  mcs_node_t* mine = lk->owner;
+  assert(mine!=NULL && mine->lock==(void*)lk);
+
+  // nobody in the main queue, so empty the lock or promote the secondary
+  // queue to be the main one
+  if (mine->lock_next == NULL) {
+    if (mine->spin == 1) {
+      if (__sync_bool_compare_and_swap(&lk->tail, mine, NULL)) {
+        dealloc_node(mine);
+        return 0;
+      }
+    } else {
+      mcs_node_t* sec_head = (mcs_node_t*)mine->spin;
+      if (__sync_bool_compare_and_swap(&lk->tail, mine, sec_head->sec_tail)) {
+        lk->handoffs = 0;
+        sec_head->spin = 1;
+        dealloc_node(mine);
+        return 0;
+      }
+    }
+    // someone arrived while I was zeroing, wait for them to link in
+    while (mine->lock_next == NULL) { } // spin
+  }
+
+  mcs_node_t* succ = NULL;
+  if (lk->handoffs < COHORT_BATCH && (succ = cna_find_successor(mine)) != NULL) {
+    lk->handoffs++;
+    succ->spin = mine->spin;
+  } else if (mine->spin > 1) {
+    // out of budget or local waiters, secondary queue goes first
+    lk->handoffs = 0;
+    succ = (mcs_node_t*)mine->spin;
+    succ->sec_tail->lock_next = mine->lock_next;
+    succ->spin = 1;
+  } else {
+    lk->handoffs = 0;
+    succ = mine->lock_next;
+    succ->spin = 1;
+  }
+
+  dealloc_node(mine);
+  return 0;
+}
+
+static int cna_lock(cna_lock_t *lk) {
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  cna_lock_common(lk,false);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int cna_trylock(cna_lock_t *lk) {
+  if (cna_lock_common(lk,true) != 0) {
+    return 1;
+  }
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int cna_unlock(cna_lock_t *lk) {
+  cna_unlock_common(lk);
+  TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+
+// pthreads reader-writer lock =====================
+//
+
+static int pthread_rdlock(txrwlock_t *lk){
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    int retval = libpthread_rwlock_rdlock(lk);
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    return retval;
+}
+static int pthread_wrlock(txrwlock_t *lk){
+    TM_STATS_ADD(MY_TM_STATS->locks, 1);
+    int retval = libpthread_rwlock_wrlock(lk);
+    TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    return retval;
+}
+static int pthread_tryrdlock(txrwlock_t *lk){
+    int retval = libpthread_rwlock_tryrdlock(lk);
+    if(retval==0){
+        TM_STATS_ADD(MY_TM_STATS->locks, 1);
+        TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    }
+    return retval;
+}
+static int pthread_trywrlock(txrwlock_t *lk){
+    int retval = libpthread_rwlock_trywrlock(lk);
+    if(retval==0){
+        TM_STATS_ADD(MY_TM_STATS->locks, 1);
+        TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+    }
+    return retval;
+}
+static int pthread_rwunlock(txrwlock_t *lk){
+    int retval = libpthread_rwlock_unlock(lk);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+    return retval;
+}
+
+
+// reader-writer lock ================================
+//
+// Writers queue on a ticket lock, then raise writer and wait for the
+// readers to drain. Readers get in whenever writer is down. A single
+// unlock serves both sides, so the writer records which thread holds it.
+// Like pthreads, the try versions return EBUSY.
+
+struct _rw_lock_t {
+  ticket_lock_t writers;
+  volatile int32_t readers;
+  volatile int32_t writer;  // a writer holds the lock or is draining readers
+  void* volatile owner;     // rw_self of the writer holding the lock
+} __attribute__((__packed__));
+
+typedef struct _rw_lock_t rw_lock_t;
+
+static __thread char rw_self;
+
+static inline bool rw_read_try(rw_lock_t *lk) {
+  if (lk->writer) {return false;}
+  __sync_fetch_and_add(&lk->readers, 1);
+  if (lk->writer == 0) {return true;}
+  // lost the race to a writer, back out
+  __sync_fetch_and_sub(&lk->readers, 1);
+  return false;
+}
+
+static inline void rw_read_acquire(rw_lock_t *lk) {
+  while (!rw_read_try(lk)) {
+    int s = spin_begin();
+    while (lk->writer) {s = spin_wait(s);}
+  }
+}
+
+static inline void rw_write_drain(rw_lock_t *lk) {
+  lk->writer = 1;
+  __sync_synchronize();
+  int s = spin_begin();
+  while (lk->readers) {s = spin_wait(s);}
+  lk->owner = &rw_self;
+}
+
+static inline void rw_release(rw_lock_t *lk) {
+  if (lk->owner == &rw_self) {
+    lk->owner = NULL;
+    lk->writer = 0;
+    __sync_synchronize();
+    lk->writers.now++;
+  } else {
+    __sync_fetch_and_sub(&lk->readers, 1);
+  }
+}
+
+static int rw_rdlock(rw_lock_t *lk) {
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  rw_read_acquire(lk);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int rw_wrlock(rw_lock_t *lk) {
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  ticket_acquire(&lk->writers);
+  rw_write_drain(lk);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int rw_tryrdlock(rw_lock_t *lk) {
+  if (!rw_read_try(lk)) {return EBUSY;}
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int rw_trywrlock(rw_lock_t *lk) {
+  if (!ticket_try_acquire(&lk->writers)) {return EBUSY;}
+  lk->writer = 1;
+  __sync_synchronize();
+  if (lk->readers) {
+    lk->writer = 0;
+    __sync_synchronize();
+    lk->writers.now++;
+    return EBUSY;
+  }
+  lk->owner = &rw_self;
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int rw_unlock(rw_lock_t *lk) {
+  rw_release(lk);
+  TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+// reader-writer lock TM ================================
+//
+// Readers that find a writer in the way speculate instead of waiting, and
+// writers speculate on their distance in the writer queue like ticket_tm.
+
+static int rw_rdlock_tm(rw_lock_t *lk) {
+  if (spec_entry){return 0;}
+
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  uint32_t tries = 0;
+  while (lk->writer && tries < TK_NUM_TRIES) {
+    if(enter_htm(lk)==0){return 0;}
+    else{tries++;}
+  }
+  rw_read_acquire(lk);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int rw_wrlock_tm(rw_lock_t *lk) {
+  if (spec_entry){return 0;}
+
+  // does the stats, and may come back speculating
+  ticket_lock_tm(&lk->writers);
+  if (spec_entry){return 0;}
+  rw_write_drain(lk);
+  return 0;
+}
+
+static int rw_tryrdlock_tm(rw_lock_t *lk) {
+  if (spec_entry) { // in htm
+    return 0;
+  }
+  return rw_tryrdlock(lk);
+}
+
+static int rw_trywrlock_tm(rw_lock_t *lk) {
+  if (spec_entry) { // in htm
+    return 0;
+  }
+  return rw_trywrlock(lk);
+}
+
+static int rw_unlock_tm(rw_lock_t *lk) {
+  if (spec_entry) { // in htm
+  } else { // not in HTM
+    rw_release(lk);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  }
+  return 0;
+}
+
+
+// reader-biased (BRAVO) reader-writer lock ================================
+//
+// While the lock is reader-biased, readers skip the lock word and publish
+// themselves in a global table of visible readers, hashed by lock and
+// thread. A writer takes the underlying rw lock, revokes the bias, and waits
+// for the published readers of its lock to leave. Readers re-enable the bias
+// from the slow path, but not before BRAVO_INHIBIT_FACTOR times the last
+// revocation's cost has passed, so frequent writers keep it off.
+
+#define BRAVO_VRT_SIZE 4096
+#define BRAVO_MAX_HELD 8
+#define BRAVO_INHIBIT_FACTOR 9
+
+struct _bravo_lock_t {
+  rw_lock_t rw;
+  volatile int32_t rbias;
+  volatile int64_t inhibit_until; // ns, no re-biasing before this
+} __attribute__((__packed__));
+
+typedef struct _bravo_lock_t bravo_lock_t;
+
+static void* volatile bravo_vrt[BRAVO_VRT_SIZE];
+
+// fast-path reads this thread holds, so unlock knows which slot to clear
+static __thread struct {
+  bravo_lock_t* lock;
+  void* volatile* slot;
+} bravo_held[BRAVO_MAX_HELD];
+static __thread int bravo_held_n = 0;
+
+static inline int64_t now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec*1000000000L + t.tv_nsec;
+}
+
+static inline void* volatile* bravo_slot(bravo_lock_t *lk) {
+  uint64_t h = ((uintptr_t)lk ^ ((uintptr_t)&rw_self << 7)) * 0x9E3779B97F4A7C15ULL;
+  return &bravo_vrt[h >> 52]; // top 12 bits, BRAVO_VRT_SIZE entries
+}
+
+static inline bool bravo_read_fast(bravo_lock_t *lk) {
+  if (!lk->rbias || bravo_held_n == BRAVO_MAX_HELD) {return false;}
+  void* volatile* slot = bravo_slot(lk);
+  if (*slot != NULL || !__sync_bool_compare_and_swap(slot, NULL, lk)) {return false;}
+  // recheck now that we're visible, a writer may have revoked meanwhile
+  if (lk->rbias) {
+    bravo_held[bravo_held_n].lock = lk;
+    bravo_held[bravo_held_n].slot = slot;
+    bravo_held_n++;
+    return true;
+  }
+  *slot = NULL;
+  return false;
+}
+
+static inline void bravo_maybe_bias(bravo_lock_t *lk) {
+  if (!lk->rbias && now_ns() >= lk->inhibit_until) {
+    lk->rbias = 1;
+  }
+}
+
+// called with the underlying write lock held
+static inline void bravo_revoke(bravo_lock_t *lk) {
+  if (!lk->rbias) {return;}
+  int64_t start = now_ns();
+  lk->rbias = 0;
+  __sync_synchronize();
+  for (int i = 0; i<BRAVO_VRT_SIZE; i++) {
+    while (bravo_vrt[i] == lk) {cpu_relax();}
+  }
+  int64_t end = now_ns();
+  lk->inhibit_until = end + (end-start)*BRAVO_INHIBIT_FACTOR;
+}
+
+// bravo_revoke for trylock: if a visible reader is still in, which may be
+// this very thread, put the bias back and give up instead of waiting
+static inline bool bravo_try_revoke(bravo_lock_t *lk) {
+  if (!lk->rbias) {return true;}
+  int64_t start = now_ns();
+  lk->rbias = 0;
+  __sync_synchronize();
+  for (int i = 0; i<BRAVO_VRT_SIZE; i++) {
+    if (bravo_vrt[i] == lk) {
+      lk->rbias = 1;
+      return false;
+    }
+  }
+  int64_t end = now_ns();
+  lk->inhibit_until = end + (end-start)*BRAVO_INHIBIT_FACTOR;
+  return true;
+}
+
+static inline void bravo_release(bravo_lock_t *lk) {
+  for (int i = bravo_held_n-1; i>=0; i--) {
+    if (bravo_held[i].lock == lk) {
+      __sync_synchronize();
+      *bravo_held[i].slot = NULL;
+      bravo_held[i] = bravo_held[--bravo_held_n];
+      return;
+    }
+  }
+  rw_release(&lk->rw);
+}
+
+static int bravo_rdlock(bravo_lock_t *lk) {
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  if (!bravo_read_fast(lk)) {
+    rw_read_acquire(&lk->rw);
+    bravo_maybe_bias(lk);
+  }
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int bravo_wrlock(bravo_lock_t *lk) {
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  ticket_acquire(&lk->rw.writers);
+  rw_write_drain(&lk->rw);
+  bravo_revoke(lk);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int bravo_tryrdlock(bravo_lock_t *lk) {
+  if (!bravo_read_fast(lk)) {
+    if (!rw_read_try(&lk->rw)) {return EBUSY;}
+    bravo_maybe_bias(lk);
+  }
+  TM_STATS_ADD(MY_TM_STATS->locks, 1);
+  TM_STATS_SUB(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+static int bravo_trywrlock(bravo_lock_t *lk) {
+  // rw_trywrlock does the stats
+  if (rw_trywrlock(&lk->rw) != 0) {return EBUSY;}
+  if (!bravo_try_revoke(lk)) {
+    rw_release(&lk->rw);
+    TM_STATS_SUB(MY_TM_STATS->locks, 1);
+    TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+    return EBUSY;
+  }
+  return 0;
+}
+
+static int bravo_unlock(bravo_lock_t *lk) {
+  bravo_release(lk);
+  TM_STATS_ADD(MY_TM_STATS->cycles, RDTSC());
+  return 0;
+}
+
+
+// lock type tables =========================
+//
+
+SEQ_ENTRY_POINTS(tas_lock, tas_trylock, tas_unlock)
+SEQ_ENTRY_POINTS(tas_lock_tm, tas_trylock_tm, tas_unlock_tm)
+SEQ_ENTRY_POINTS(tas_priority_lock_tm, tas_priority_trylock_tm, tas_priority_unlock_tm)
+SEQ_ENTRY_POINTS(tas_lock_hle, tas_trylock_hle, tas_unlock_hle)
+SEQ_ENTRY_POINTS(tas_park_lock, tas_park_trylock, tas_park_unlock)
+SEQ_ENTRY_POINTS(tas_park_lock_tm, tas_park_trylock_tm, tas_park_unlock_tm)
+SEQ_ENTRY_POINTS(ticket_lock, ticket_trylock, ticket_unlock)
+SEQ_ENTRY_POINTS(ticket_lock_tm, ticket_trylock_tm, ticket_unlock_tm)
+SEQ_ENTRY_POINTS(ticket_park_lock, ticket_park_trylock, ticket_park_unlock)
+SEQ_ENTRY_POINTS(ticket_park_lock_tm, ticket_park_trylock_tm, ticket_park_unlock_tm)
+SEQ_ENTRY_POINTS(mcs_lock, mcs_trylock, mcs_unlock)
+SEQ_ENTRY_POINTS(mcs_lock_tm, mcs_trylock_tm, mcs_unlock_tm)
+SEQ_ENTRY_POINTS(mcs_park_lock, mcs_park_trylock, mcs_park_unlock)
+SEQ_ENTRY_POINTS(mcs_park_lock_tm, mcs_park_trylock_tm, mcs_park_unlock_tm)
+SEQ_ENTRY_POINTS(clh_lock, clh_trylock, clh_unlock)
+SEQ_ENTRY_POINTS(clh_lock_tm, clh_trylock_tm, clh_unlock_tm)
+SEQ_ENTRY_POINTS(cohort_lock, cohort_trylock, cohort_unlock)
+SEQ_ENTRY_POINTS(cohort_lock_tm, cohort_trylock_tm, cohort_unlock_tm)
+SEQ_ENTRY_POINTS(cna_lock, cna_trylock, cna_unlock)
+
+lock_type_t TL_STATS_TABLE(lock_types)[] = {
+    {"pthread",     sizeof(pthread_mutex_t), false, (txlock_func_t)pthread_lock, (txlock_func_t)pthread_trylock, (txlock_func_t)pthread_unlock,
+                    (txlock_func_t)pthread_lock, (txlock_func_t)pthread_trylock, (txlock_func_t)pthread_unlock},
+    {"pthread_tm",  sizeof(pthread_mutex_t), true, (txlock_func_t)pthread_lock_tm, (txlock_func_t)pthread_trylock_tm, (txlock_func_t)pthread_unlock_tm,
+                    (txlock_func_t)pthread_lock_tm, (txlock_func_t)pthread_trylock_tm, (txlock_func_t)pthread_unlock_tm},
+    {"tas", sizeof(tas_lock_t), false, (txlock_func_t)tas_lock, (txlock_func_t)tas_trylock, (txlock_func_t)tas_unlock,
+                    tas_lock_seq, tas_trylock_seq, tas_unlock_seq},
+    {"tas_tm", sizeof(tas_lock_t), true, (txlock_func_t)tas_lock_tm, (txlock_func_t)tas_trylock_tm, (txlock_func_t)tas_unlock_tm,
+                    tas_lock_tm_seq, tas_trylock_tm_seq, tas_unlock_tm_seq},
+    {"tas_priority_tm", sizeof(tas_lock_t), true, (txlock_func_t)tas_priority_lock_tm, (txlock_func_t)tas_priority_trylock_tm, (txlock_func_t)tas_priority_unlock_tm,
+                    tas_priority_lock_tm_seq, tas_priority_trylock_tm_seq, tas_priority_unlock_tm_seq},
+    {"tas_hle", sizeof(tas_lock_t), true, (txlock_func_t)tas_lock_hle, (txlock_func_t)tas_trylock_hle, (txlock_func_t)tas_unlock_hle,
+                    tas_lock_hle_seq, tas_trylock_hle_seq, tas_unlock_hle_seq},
+    {"tas_park", sizeof(tas_lock_t), false, (txlock_func_t)tas_park_lock, (txlock_func_t)tas_park_trylock, (txlock_func_t)tas_park_unlock,
+                    tas_park_lock_seq, tas_park_trylock_seq, tas_park_unlock_seq},
+    {"tas_park_tm", sizeof(tas_lock_t), true, (txlock_func_t)tas_park_lock_tm, (txlock_func_t)tas_park_trylock_tm, (txlock_func_t)tas_park_unlock_tm,
+                    tas_park_lock_tm_seq, tas_park_trylock_tm_seq, tas_park_unlock_tm_seq},
+    {"ticket", sizeof(ticket_lock_t), false, (txlock_func_t)ticket_lock, (txlock_func_t)ticket_trylock, (txlock_func_t)ticket_unlock,
+                    ticket_lock_seq, ticket_trylock_seq, ticket_unlock_seq},
+    {"ticket_tm", sizeof(ticket_lock_t), true, (txlock_func_t)ticket_lock_tm, (txlock_func_t)ticket_trylock_tm, (txlock_func_t)ticket_unlock_tm,
+                    ticket_lock_tm_seq, ticket_trylock_tm_seq, ticket_unlock_tm_seq},
+    {"ticket_park", sizeof(ticket_park_lock_t), false, (txlock_func_t)ticket_park_lock, (txlock_func_t)ticket_park_trylock, (txlock_func_t)ticket_park_unlock,
+                    ticket_park_lock_seq, ticket_park_trylock_seq, ticket_park_unlock_seq},
+    {"ticket_park_tm", sizeof(ticket_park_lock_t), true, (txlock_func_t)ticket_park_lock_tm, (txlock_func_t)ticket_park_trylock_tm, (txlock_func_t)ticket_park_unlock_tm,
+                    ticket_park_lock_tm_seq, ticket_park_trylock_tm_seq, ticket_park_unlock_tm_seq},
+    {"mcs", sizeof(mcs_lock_t), false, (txlock_func_t)mcs_lock, (txlock_func_t)mcs_trylock, (txlock_func_t)mcs_unlock,
+                    mcs_lock_seq, mcs_trylock_seq, mcs_unlock_seq},
+    {"mcs_tm", sizeof(mcs_lock_t), true, (txlock_func_t)mcs_lock_tm, (txlock_func_t)mcs_trylock_tm, (txlock_func_t)mcs_unlock_tm,
+                    mcs_lock_tm_seq, mcs_trylock_tm_seq, mcs_unlock_tm_seq},
+    {"mcs_park", sizeof(mcs_lock_t), false, (txlock_func_t)mcs_park_lock, (txlock_func_t)mcs_park_trylock, (txlock_func_t)mcs_park_unlock,
+                    mcs_park_lock_seq, mcs_park_trylock_seq, mcs_park_unlock_seq},
+    {"mcs_park_tm", sizeof(mcs_lock_t), true, (txlock_func_t)mcs_park_lock_tm, (txlock_func_t)mcs_park_trylock_tm, (txlock_func_t)mcs_park_unlock_tm,
+                    mcs_park_lock_tm_seq, mcs_park_trylock_tm_seq, mcs_park_unlock_tm_seq},
+    {"clh", sizeof(clh_lock_t), false, (txlock_func_t)clh_lock, (txlock_func_t)clh_trylock, (txlock_func_t)clh_unlock,
+                    clh_lock_seq, clh_trylock_seq, clh_unlock_seq},
+    {"clh_tm", sizeof(clh_lock_t), true, (txlock_func_t)clh_lock_tm, (txlock_func_t)clh_trylock_tm, (txlock_func_t)clh_unlock_tm,
+                    clh_lock_tm_seq, clh_trylock_tm_seq, clh_unlock_tm_seq},
+    {"cohort", sizeof(cohort_lock_t), false, (txlock_func_t)cohort_lock, (txlock_func_t)cohort_trylock, (txlock_func_t)cohort_unlock,
+                    cohort_lock_seq, cohort_trylock_seq, cohort_unlock_seq},
+    {"cohort_tm", sizeof(cohort_lock_t), true, (txlock_func_t)cohort_lock_tm, (txlock_func_t)cohort_trylock_tm, (txlock_func_t)cohort_unlock_tm,
+                    cohort_lock_tm_seq, cohort_trylock_tm_seq, cohort_unlock_tm_seq},
+    {"cna", sizeof(cna_lock_t), false, (txlock_func_t)cna_lock, (txlock_func_t)cna_trylock, (txlock_func_t)cna_unlock,
+                    cna_lock_seq, cna_trylock_seq, cna_unlock_seq}
+};
+_Static_assert(sizeof(TL_STATS_TABLE(lock_types))/sizeof(lock_type_t) == TL_NUM_LOCK_TYPES, "update TL_NUM_LOCK_TYPES");
+
+rwlock_type_t TL_STATS_TABLE(rwlock_types)[] = {
+    {"pthread",  sizeof(pthread_rwlock_t), pthread_rdlock, pthread_wrlock, pthread_tryrdlock, pthread_trywrlock, pthread_rwunlock},
+    {"rw",       sizeof(rw_lock_t), (txrwlock_func_t)rw_rdlock, (txrwlock_func_t)rw_wrlock, (txrwlock_func_t)rw_tryrdlock, (txrwlock_func_t)rw_trywrlock, (txrwlock_func_t)rw_unlock},
+    {"rw_tm",    sizeof(rw_lock_t), (txrwlock_func_t)rw_rdlock_tm, (txrwlock_func_t)rw_wrlock_tm, (txrwlock_func_t)rw_tryrdlock_tm, (txrwlock_func_t)rw_trywrlock_tm, (txrwlock_func_t)rw_unlock_tm},
+    {"bravo",    sizeof(bravo_lock_t), (txrwlock_func_t)bravo_rdlock, (txrwlock_func_t)bravo_wrlock, (txrwlock_func_t)bravo_tryrdlock, (txrwlock_func_t)bravo_trywrlock, (txrwlock_func_t)bravo_unlock}
+};
+_Static_assert(sizeof(TL_STATS_TABLE(rwlock_types))/sizeof(rwlock_type_t) == TL_NUM_RWLOCK_TYPES, "update TL_NUM_RWLOCK_TYPES");
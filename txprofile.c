@@ -0,0 +1,621 @@
+#define _GNU_SOURCE // for dladdr()
+
+// Per-lock and per-call-site profile, and call-site policies.
+//
+// With LIBTXLOCK_PROFILE=n or LIBTXLOCK_POLICY=file, tl_lock, tl_trylock and
+// tl_unlock resolve to the wrappers here instead of the lock type's entry
+// points, and tl-pthread.so's pthread_mutex_* pass along who called them.
+// Each thread profiles one in n of its acquisitions into a table keyed by
+// lock address and one keyed by call site; unlike the addresses, the call
+// sites are the same from run to run. The policy file gives the functions it
+// names their own speculation tuning, see load_policies. At the timing stats
+// level the wrappers also keep latency histograms of every acquisition.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "txlock.h"
+#include "txutil.h"
+#include "txlock_internal.h"
+#include "txhist.h"
+
+// open addressing, so a lookup is a hash and usually a single probe; slots
+// are claimed with a CAS on the key and never freed, so a destroyed lock's
+// numbers stay with its address
+#define PROFILE_BITS  12
+#define PROFILE_SLOTS (1 << PROFILE_BITS)
+#define MAX_FRAMES    4
+
+typedef struct {
+    volatile uint64_t key; // lock address, or hash of the call stack
+    const void* frames[MAX_FRAMES]; // call sites only, innermost first
+    int64_t acquisitions;
+    int64_t contended;     // acquisitions and trylocks that found it taken
+    int64_t wait_cycles;
+    int64_t hold_cycles;
+    int64_t tries;         // HTM, from this thread's tm_stats_t
+    int64_t commits;
+    int64_t conflicts;
+    int64_t overflows;
+    int64_t explicits;
+} __attribute__((aligned(CACHE_LINE_SIZE))) profile_entry_t;
+
+static profile_entry_t lock_table[PROFILE_SLOTS];
+static profile_entry_t site_table[PROFILE_SLOTS];
+static int64_t profile_dropped = 0; // samples lost to a full table
+static int profile_frames = 1;
+static int profile_top = 10;
+
+TL_INTERNAL int tl_profile_sample = 0;
+TL_INTERNAL bool tl_sited = false;
+TL_INTERNAL lock_type_t *tl_profile_type = NULL;
+
+// sampled (or with tl_timed, all) locks this thread holds, to time the hold
+// at unlock
+#define MAX_HELD 16
+typedef struct {
+    txlock_t* lock;
+    profile_entry_t* entry;
+    profile_entry_t* site;
+    uint64_t since;
+} held_sample_t;
+
+static __thread int countdown = 0;
+static __thread int num_held = 0;
+static __thread held_sample_t held[MAX_HELD];
+
+static inline size_t hash_bits(uint64_t key) {
+    return (key * 0x9e3779b97f4a7c15ULL) >> (64 - PROFILE_BITS);
+}
+
+static profile_entry_t* profile_entry(profile_entry_t *table, uint64_t key) {
+    size_t i = hash_bits(key);
+    for (size_t n=0; n<PROFILE_SLOTS; n++, i=(i+1)&(PROFILE_SLOTS-1)) {
+        profile_entry_t* e = &table[i];
+        if (e->key == key)
+            return e;
+        if (e->key == 0 && (__sync_bool_compare_and_swap(&e->key, 0, key) || e->key == key))
+            return e;
+    }
+    __sync_fetch_and_add(&profile_dropped, 1);
+    return NULL;
+}
+
+// The entry of the call stack above site, the return address of the
+// tl_lock or pthread_mutex_lock call. Deeper frames come from backtrace,
+// which finds site among the frames of the wrappers.
+static profile_entry_t* site_entry(const void *site) {
+    const void* frames[MAX_FRAMES] = {site};
+    if (profile_frames > 1) {
+        void* bt[MAX_FRAMES + 8];
+        int depth = backtrace(bt, MAX_FRAMES + 8);
+        for (int i=0; i<depth; i++) {
+            if (bt[i] == site) {
+                for (int f=1; f<profile_frames && i+f<depth; f++)
+                    frames[f] = bt[i+f];
+                break;
+            }
+        }
+    }
+    uint64_t key = 0;
+    for (int f=0; f<MAX_FRAMES; f++)
+        key = (key ^ (uintptr_t)frames[f]) * 0x100000001b3ULL;
+
+    profile_entry_t* e = profile_entry(site_table, key | 1);
+    if (e && !e->frames[0])
+        memcpy((void*)e->frames, frames, sizeof(frames));
+    return e;
+}
+
+static inline bool take_sample() {
+    // nothing shared gets written while speculating, it would only add
+    // conflicts to a transaction that is thrown away anyway
+    if (!tl_profile_sample || --countdown > 0 || spec_entry || num_held == MAX_HELD)
+        return false;
+    countdown = tl_profile_sample;
+    return true;
+}
+
+static void add_sample(profile_entry_t *e, bool acquired, bool contended, uint64_t wait) {
+    if (acquired)
+        __sync_fetch_and_add(&e->acquisitions, 1);
+    if (contended)
+        __sync_fetch_and_add(&e->contended, 1);
+    if (wait)
+        __sync_fetch_and_add(&e->wait_cycles, wait);
+}
+
+// HTM outcomes this thread counted since *from
+static void add_htm(profile_entry_t *e, tm_stats_t *from) {
+    tm_stats_t *st = my_tm_stats; // NULL in threads that started unseen
+    if (!st || !e)
+        return;
+    if (st->tries != from->tries)
+        __sync_fetch_and_add(&e->tries, st->tries - from->tries);
+    if (st->commits != from->commits)
+        __sync_fetch_and_add(&e->commits, st->commits - from->commits);
+    if (st->conflicts != from->conflicts)
+        __sync_fetch_and_add(&e->conflicts, st->conflicts - from->conflicts);
+    if (st->overflows != from->overflows)
+        __sync_fetch_and_add(&e->overflows, st->overflows - from->overflows);
+    if (st->explicits != from->explicits)
+        __sync_fetch_and_add(&e->explicits, st->explicits - from->explicits);
+}
+
+static void htm_before(tm_stats_t *from) {
+    if (my_tm_stats)
+        *from = *my_tm_stats;
+}
+
+static void hold_sample(txlock_t *l, profile_entry_t *e, profile_entry_t *site, uint64_t now) {
+    if (num_held == MAX_HELD)
+        return;
+    held[num_held].lock = l;
+    held[num_held].entry = e;
+    held[num_held].site = site;
+    held[num_held].since = now;
+    num_held++;
+}
+
+
+// latency histograms =========================
+//
+// Wait and hold times in cycles, in txhist.h histograms. Each thread fills
+// its own pair, and the report merges them and converts to ns at the TSC
+// rate measured on load. An exiting thread's pair goes to
+// the next new thread, which keeps adding to it.
+
+typedef struct _thread_hists_t {
+    hist_t wait;
+    hist_t hold;
+    struct _thread_hists_t* volatile next;
+    struct _thread_hists_t* free_next;
+} thread_hists_t;
+
+TL_INTERNAL bool tl_timed = false;
+static thread_hists_t* volatile hists_head = NULL;
+static __thread thread_hists_t* my_hists = NULL;
+static thread_hists_t* free_hists = NULL;
+static utility_lock_t free_hists_lock;
+static pthread_key_t hists_key;
+static bool hists_key_ready = false;
+
+static thread_hists_t* thread_hists() {
+    if (!my_hists) {
+        if (free_hists) {
+            ul_lock(&free_hists_lock);
+            if ((my_hists = free_hists) != NULL)
+                free_hists = my_hists->free_next;
+            ul_unlock(&free_hists_lock);
+        }
+        if (!my_hists) {
+            // not malloc, which may take a pthread mutex itself
+            void *m = mmap(NULL, sizeof(thread_hists_t), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (m == MAP_FAILED)
+                return NULL;
+            my_hists = m;
+            do {
+                my_hists->next = hists_head;
+            } while (!__sync_bool_compare_and_swap(&hists_head, my_hists->next, my_hists));
+        }
+        if (hists_key_ready)
+            pthread_setspecific(hists_key, my_hists);
+    }
+    return my_hists;
+}
+
+// pthread key destructor
+static void release_thread_hists(void* hists) {
+    thread_hists_t *h = hists;
+    my_hists = NULL;
+    ul_lock(&free_hists_lock);
+    h->free_next = free_hists;
+    free_hists = h;
+    ul_unlock(&free_hists_lock);
+}
+
+// ns if the TSC rate is known, cycles otherwise
+static double hist_unit() {
+    return tl_tsc_per_ns > 0 ? tl_tsc_per_ns : 1;
+}
+
+static void print_hist(const char *name, const hist_t *h) {
+    double per = hist_unit();
+    fprintf(stderr, "%-5s %12ld %10.0f %10.0f %10.0f %10.0f %10.0f\n", name, h->count,
+            hist_percentile(h, 0.5)/per, hist_percentile(h, 0.9)/per,
+            hist_percentile(h, 0.99)/per, hist_percentile(h, 0.999)/per, h->max/per);
+}
+
+// every thread's wait and hold histograms, summed; free() the result
+static hist_t* merge_hists() {
+    hist_t *sum = calloc(2, sizeof(hist_t));
+    if (!sum)
+        return NULL;
+    for (thread_hists_t *t = hists_head; t; t = t->next) {
+        const hist_t *from[2] = {&t->wait, &t->hold};
+        for (int w=0; w<2; w++)
+            hist_merge(&sum[w], from[w]);
+    }
+    return sum;
+}
+
+void tl_latency_report() {
+    if (!tl_timed)
+        return;
+    hist_t *sum = merge_hists();
+    if (!sum)
+        return;
+
+    if (tl_tsc_per_ns > 0)
+        fprintf(stderr, "LIBTXLOCK latency in ns, %.3f cycles/ns:\n", tl_tsc_per_ns);
+    else
+        fprintf(stderr, "LIBTXLOCK latency in cycles:\n");
+    fprintf(stderr, "%-5s %12s %10s %10s %10s %10s %10s\n", "", "count", "p50", "p90", "p99",
+            "p99.9", "max");
+    print_hist("wait", &sum[0]);
+    print_hist("hold", &sum[1]);
+    fflush(stderr);
+    free(sum);
+}
+
+TL_INTERNAL bool tl_latency_summary(tl_latency_t lat[2]) {
+    if (!tl_timed)
+        return false;
+    hist_t *sum = merge_hists();
+    if (!sum)
+        return false;
+    double per = hist_unit();
+    for (int w=0; w<2; w++) {
+        lat[w].count = sum[w].count;
+        lat[w].p50 = hist_percentile(&sum[w], 0.5)/per;
+        lat[w].p90 = hist_percentile(&sum[w], 0.9)/per;
+        lat[w].p99 = hist_percentile(&sum[w], 0.99)/per;
+        lat[w].p999 = hist_percentile(&sum[w], 0.999)/per;
+        lat[w].max = sum[w].max/per;
+    }
+    free(sum);
+    return true;
+}
+
+TL_INTERNAL void tl_latency_buckets(int which, tl_latency_bucket_fn fn, void *arg) {
+    if (!tl_timed)
+        return;
+    hist_t *sum = merge_hists();
+    if (!sum)
+        return;
+    double per = hist_unit();
+    for (int i=0; i<HIST_BUCKETS; i++) {
+        if (sum[which].buckets[i])
+            fn(arg, hist_value(i)/per, sum[which].buckets[i]);
+    }
+    free(sum);
+}
+
+
+// call-site policies =========================
+//
+// The policy file has a line per function, its symbol name followed by
+// settings for the acquisitions its calls make:
+//
+//   # symbol         settings
+//   btree_split      nospec
+//   log_flush        park
+//   hash_insert      tries=4 min=0 max=1
+//
+// nospec never speculates, park makes the _park types sleep without
+// spinning first, and tries, min and max set LIBTXLOCK_NUM_TRIES and the
+// distances. The names are matched against dladdr() of the call site, so
+// functions in the executable need -rdynamic.
+
+typedef struct {
+    char name[64];
+    tl_policy_t policy;
+} named_policy_t;
+
+static named_policy_t* policies = NULL;
+static int num_policies = 0;
+
+// policy of each call site seen so far; NULL is the defaults
+#define POLICY_SLOTS 1024
+typedef struct {
+    const void* volatile site;
+    const tl_policy_t* volatile policy;
+} site_policy_t;
+
+static site_policy_t policy_cache[POLICY_SLOTS];
+
+static const tl_policy_t* lookup_policy(const void *site) {
+    Dl_info info;
+    if (!dladdr(site, &info) || !info.dli_sname)
+        return NULL;
+    for (int p=0; p<num_policies; p++) {
+        if (strcmp(info.dli_sname, policies[p].name) == 0)
+            return &policies[p].policy;
+    }
+    return NULL;
+}
+
+static const tl_policy_t* site_policy(const void *site) {
+    size_t i = hash_bits((uintptr_t)site) & (POLICY_SLOTS-1);
+    for (size_t n=0; n<POLICY_SLOTS; n++, i=(i+1)&(POLICY_SLOTS-1)) {
+        site_policy_t* c = &policy_cache[i];
+        if (c->site == site)
+            return c->policy; // a racing first lookup may still see NULL
+        if (c->site == NULL) {
+            const tl_policy_t* policy = lookup_policy(site);
+            if (__sync_bool_compare_and_swap(&c->site, NULL, site))
+                c->policy = policy;
+            else if (c->site != site)
+                continue;
+            return policy;
+        }
+    }
+    return NULL;
+}
+
+static void load_policies(const char *path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return;
+    }
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char* save;
+        char* name = strtok_r(line, " \t\n", &save);
+        if (!name || name[0] == '#')
+            continue;
+
+        named_policy_t* np = realloc(policies, (num_policies+1)*sizeof(named_policy_t));
+        if (!np)
+            break;
+        policies = np;
+        named_policy_t* p = &policies[num_policies];
+        strncpy(p->name, name, sizeof(p->name)-1);
+        p->name[sizeof(p->name)-1] = '\0';
+        p->policy = (tl_policy_t){TK_NUM_TRIES, TK_MIN_DISTANCE, TK_MAX_DISTANCE, SPIN_PARK};
+
+        char* set;
+        while ((set = strtok_r(NULL, " \t\n", &save)) != NULL && set[0] != '#') {
+            if (strcmp(set, "nospec") == 0) {
+                // an empty distance window stops the queue locks too
+                p->policy.num_tries = 0;
+                p->policy.min_distance = 1;
+                p->policy.max_distance = 0;
+            }
+            else if (strcmp(set, "park") == 0)
+                p->policy.park_spin = 0;
+            else if (strncmp(set, "tries=", 6) == 0)
+                p->policy.num_tries = atoi(set+6);
+            else if (strncmp(set, "min=", 4) == 0)
+                p->policy.min_distance = atoi(set+4);
+            else if (strncmp(set, "max=", 4) == 0)
+                p->policy.max_distance = atoi(set+4);
+            else
+                fprintf(stderr, "%s:%d: unknown setting %s\n", path, lineno, set);
+        }
+        num_policies++;
+    }
+    fclose(f);
+}
+
+// Called by init_lib_txlock once the TK_* defaults, which the policies
+// start from, are final
+TL_INTERNAL void tl_profile_init() {
+    const char* env;
+    if ((env = getenv("LIBTXLOCK_PROFILE_TOP")) != NULL)
+        profile_top = atoi(env);
+    if ((env = getenv("LIBTXLOCK_PROFILE_FRAMES")) != NULL)
+        profile_frames = atoi(env);
+    if (profile_frames < 1)
+        profile_frames = 1;
+    if (profile_frames > MAX_FRAMES)
+        profile_frames = MAX_FRAMES;
+    if (profile_frames > 1 && tl_profile_sample) {
+        // the first backtrace loads libgcc, better not inside a lock
+        void* bt[1];
+        backtrace(bt, 1);
+    }
+    if ((env = getenv("LIBTXLOCK_POLICY")) != NULL && *env)
+        load_policies(env);
+    if (tl_timed) {
+        tl_calibrate_tsc();
+        pthread_key_create(&hists_key, release_thread_hists);
+        hists_key_ready = true;
+        if (my_hists)
+            pthread_setspecific(hists_key, my_hists);
+    }
+}
+
+
+// entry points =========================
+//
+
+TL_INTERNAL int tl_lock_at(txlock_t *l, const void *site) {
+    tl_policy = num_policies ? site_policy(site) : NULL;
+    bool sample = take_sample();
+    if (!sample && !tl_timed) {
+        int ret = tl_profile_type->tl_lock_fun(l);
+        tl_policy = NULL;
+        return ret;
+    }
+
+    tm_stats_t from;
+    if (sample)
+        htm_before(&from);
+    uint64_t start = rdtsc();
+    // samples try first, to tell the contended acquisitions apart
+    bool contended = sample && tl_profile_type->tl_trylock_fun(l) != 0;
+    int ret = 0;
+    if (!sample || contended)
+        ret = tl_profile_type->tl_lock_fun(l);
+    tl_policy = NULL;
+    // a failed lock (say EDEADLK) isn't held, and a speculative one is
+    // counted when it really gets the lock
+    if (ret != 0 || spec_entry)
+        return ret;
+    uint64_t now = rdtsc();
+
+    profile_entry_t *e = NULL, *s = NULL;
+    if (sample) {
+        uint64_t wait = contended ? now - start : 0;
+        e = profile_entry(lock_table, (uintptr_t)l);
+        s = site_entry(site);
+        if (e) {
+            add_sample(e, true, contended, wait);
+            add_htm(e, &from);
+        }
+        if (s) {
+            add_sample(s, true, contended, wait);
+            add_htm(s, &from);
+        }
+    }
+    if (tl_timed && thread_hists())
+        hist_add(&my_hists->wait, now - start);
+    if (tl_timed || e || s)
+        hold_sample(l, e, s, rdtsc()); // not counting the bookkeeping
+    return ret;
+}
+
+TL_INTERNAL int tl_trylock_at(txlock_t *l, const void *site) {
+    tl_policy = num_policies ? site_policy(site) : NULL;
+    bool sample = take_sample();
+    int ret = tl_profile_type->tl_trylock_fun(l);
+    tl_policy = NULL;
+    if ((!sample && !tl_timed) || spec_entry)
+        return ret;
+
+    profile_entry_t *e = NULL, *s = NULL;
+    if (sample) {
+        e = profile_entry(lock_table, (uintptr_t)l);
+        s = site_entry(site);
+        if (e)
+            add_sample(e, ret == 0, ret != 0, 0);
+        if (s)
+            add_sample(s, ret == 0, ret != 0, 0);
+    }
+    if (ret == 0 && (tl_timed || e || s))
+        hold_sample(l, e, s, rdtsc());
+    return ret;
+}
+
+// what tl_lock & co resolve to, for programs that call them directly
+TL_INTERNAL int tl_lock_profiled(txlock_t *l) {
+    return tl_lock_at(l, __builtin_return_address(0));
+}
+
+TL_INTERNAL int tl_trylock_profiled(txlock_t *l) {
+    return tl_trylock_at(l, __builtin_return_address(0));
+}
+
+TL_INTERNAL int tl_unlock_profiled(txlock_t *l) {
+    int i = spec_entry ? -1 : num_held - 1;
+    while (i >= 0 && held[i].lock != l)
+        i--;
+    if (i < 0)
+        return tl_profile_type->tl_unlock_fun(l);
+
+    held_sample_t h = held[i];
+    held[i] = held[--num_held];
+    uint64_t hold = rdtsc() - h.since;
+    if (h.entry)
+        __sync_fetch_and_add(&h.entry->hold_cycles, hold);
+    if (h.site)
+        __sync_fetch_and_add(&h.site->hold_cycles, hold);
+    if (tl_timed && thread_hists())
+        hist_add(&my_hists->hold, hold);
+
+    tm_stats_t from;
+    htm_before(&from);
+    int ret = tl_profile_type->tl_unlock_fun(l);
+    // elided sections commit here
+    add_htm(h.entry, &from);
+    add_htm(h.site, &from);
+    return ret;
+}
+
+
+// report =========================
+//
+
+static int by_contention(const void *a, const void *b) {
+    const profile_entry_t *x = a, *y = b;
+    if (x->contended != y->contended)
+        return x->contended < y->contended ? 1 : -1;
+    if (x->wait_cycles != y->wait_cycles)
+        return x->wait_cycles < y->wait_cycles ? 1 : -1;
+    return (x->acquisitions < y->acquisitions) - (x->acquisitions > y->acquisitions);
+}
+
+static void print_frame(const void *pc) {
+    Dl_info info;
+    if (!dladdr(pc, &info)) {
+        fprintf(stderr, "%p", pc);
+    } else if (info.dli_sname) {
+        fprintf(stderr, "%s+%#lx", info.dli_sname, (uintptr_t)pc - (uintptr_t)info.dli_saddr);
+    } else {
+        const char* file = strrchr(info.dli_fname, '/');
+        fprintf(stderr, "%s+%#lx", file ? file+1 : info.dli_fname,
+                (uintptr_t)pc - (uintptr_t)info.dli_fbase);
+    }
+}
+
+static void report_table(profile_entry_t *table, const char *by, int top) {
+    // a copy, the table keeps changing under us
+    profile_entry_t *entries = malloc(PROFILE_SLOTS*sizeof(profile_entry_t));
+    if (!entries)
+        return;
+    int n = 0;
+    for (int i=0; i<PROFILE_SLOTS; i++) {
+        if (table[i].key)
+            entries[n++] = table[i];
+    }
+    qsort(entries, n, sizeof(profile_entry_t), by_contention);
+
+    fprintf(stderr, "by %s, %d seen, top %d by contention:\n", by, n, top < n ? top : n);
+    fprintf(stderr, "%10s %10s %10s %10s %8s %8s %8s %8s %8s  %s\n", "acqs", "contended",
+            "avg_wait", "avg_hold", "tm_tries", "commits", "conflict", "overflow", "explicit", by);
+    for (int i=0; i<n && i<top; i++) {
+        profile_entry_t *e = &entries[i];
+        fprintf(stderr, "%10ld %10ld %10ld %10ld %8ld %8ld %8ld %8ld %8ld  ",
+                e->acquisitions, e->contended,
+                e->contended ? e->wait_cycles/e->contended : 0,
+                e->acquisitions ? e->hold_cycles/e->acquisitions : 0,
+                e->tries, e->commits, e->conflicts, e->overflows, e->explicits);
+        if (table == lock_table) {
+            fprintf(stderr, "%p", (void*)e->key);
+        } else {
+            for (int f=0; f<MAX_FRAMES && e->frames[f]; f++) {
+                if (f) {fprintf(stderr, " < ");}
+                print_frame(e->frames[f]);
+            }
+        }
+        fprintf(stderr, "\n");
+    }
+    free(entries);
+}
+
+void tl_profile_report(int top) {
+    if (!tl_profile_sample)
+        return;
+    if (top <= 0)
+        top = profile_top;
+
+    fprintf(stderr, "LIBTXLOCK profile, 1 in %d acquisitions", tl_profile_sample);
+    if (profile_dropped)
+        fprintf(stderr, ", %ld samples dropped (table full)", profile_dropped);
+    fprintf(stderr, "\n");
+    report_table(lock_table, "lock", top);
+    report_table(site_table, "call site", top);
+    fflush(stderr);
+}
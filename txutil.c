@@ -1,8 +1,13 @@
+#define _GNU_SOURCE // for sched_getcpu()
+
+#include <sched.h>
+
 #include "txutil.h"
 
 int SPIN_INIT = 16;
 int SPIN_CELL = 1024;
 float SPIN_FACTOR = 2;
+int SPIN_PARK = 1024; // spins before a parking lock sleeps, calibrated on load
 tm_stats_t *tm_stats_head = 0; // stats for master thread and head of list
 __thread tm_stats_t* my_tm_stats = 0; // thread-local stats
 tm_stats_t tm_stats = {0};             // global stats, updated only when a thread exits
@@ -14,5 +19,105 @@ __thread void * volatile __attribute__ ((aligned(128))) spec_entry = 0;
 uint32_t TK_MIN_DISTANCE = 0;
 uint32_t TK_MAX_DISTANCE = 2;
 uint32_t TK_NUM_TRIES    = 2;
+uint32_t COHORT_BATCH    = 64;
+__thread const tl_policy_t* tl_policy = NULL;
 bool TM_COND_VARS = true;
+bool TM_SEQ_READS = false;
 bool USE_PTHREAD_COND_VARS = true;
+
+// out-of-line copies of the inline helpers in txutil.h, for callers that
+// don't get them inlined (e.g. programs built with TXLOCK_TYPE at -O0)
+#if defined(__x86_64__) || defined(__x86_64)
+extern inline uint64_t rdtsc();
+#endif
+extern inline void cpu_relax();
+extern inline int spin_begin();
+extern inline int spin_wait(int s);
+extern inline int ul_lock(utility_lock_t *lk);
+extern inline int ul_unlock(utility_lock_t *lk);
+
+// TSC rate =========================
+//
+// Measured against CLOCK_MONOTONIC over a short sleep, which is long enough
+// for the 10ms to swamp the cost of reading the two clocks.
+
+double tl_tsc_per_ns = 0;
+
+void tl_calibrate_tsc() {
+    struct timespec t0, t1, nap = {0, 10000000};
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t c0 = rdtsc();
+    nanosleep(&nap, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    uint64_t c1 = rdtsc();
+    double ns = (t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec);
+    if (ns > 0)
+        tl_tsc_per_ns = (c1 - c0)/ns;
+}
+
+// NUMA topology =========================
+//
+// cpu -> node map read from /sys/devices/system/node/node*/cpulist.
+// LIBTXLOCK_NUMA_NODES=n fakes a machine with n nodes instead, placing
+// threads on them round-robin in the order they first ask, so the NUMA
+// aware locks can be exercised on a single-socket box.
+
+#define TL_MAX_CPUS 4096
+
+int tl_numa_nodes = 1;
+static int16_t cpu_to_node[TL_MAX_CPUS];
+static bool numa_fake = false;
+static int next_fake_node = 0;
+static __thread int my_fake_node = -1;
+
+static void parse_cpulist(FILE* f, int node) {
+    int lo, hi;
+    while (fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        int c = fgetc(f);
+        if (c == '-') {
+            if (fscanf(f, "%d", &hi) != 1)
+                return;
+            c = fgetc(f);
+        }
+        for (int cpu = lo; cpu <= hi && cpu < TL_MAX_CPUS; cpu++)
+            cpu_to_node[cpu] = node;
+        if (c != ',')
+            return;
+    }
+}
+
+void tl_numa_init() {
+    const char* env = getenv("LIBTXLOCK_NUMA_NODES");
+    if (env && atoi(env) > 0) {
+        tl_numa_nodes = atoi(env);
+        if (tl_numa_nodes > TL_MAX_NUMA_NODES)
+            tl_numa_nodes = TL_MAX_NUMA_NODES;
+        numa_fake = true;
+        return;
+    }
+
+    // node ids may be sparse, so probe all of them
+    for (int node = 0; node < TL_MAX_NUMA_NODES; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE* f = fopen(path, "r");
+        if (!f)
+            continue;
+        parse_cpulist(f, node);
+        fclose(f);
+        tl_numa_nodes = node+1;
+    }
+}
+
+int tl_numa_node() {
+    if (numa_fake) {
+        if (my_fake_node < 0)
+            my_fake_node = __sync_fetch_and_add(&next_fake_node, 1) % tl_numa_nodes;
+        return my_fake_node;
+    }
+    int cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= TL_MAX_CPUS)
+        return 0;
+    return cpu_to_node[cpu];
+}
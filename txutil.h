@@ -24,6 +24,7 @@
     #define HTM_ABORT_OVERFLOW(c)  ((c) & _XABORT_CAPACITY)
     #define HTM_ABORT_EXPLICIT(c)  ((c) & _XABORT_EXPLICIT)
     #define HTM_IS_ACTIVE()     _xtest()
+    #define CACHE_LINE_SIZE     64
 
     inline uint64_t rdtsc() { return __rdtsc(); }
 
@@ -36,6 +37,7 @@
     #define HTM_SUCCESSFUL      1
     #define HTM_SUSPEND()       __builtin_tsuspend()
     #define HTM_RESUME()        __builtin_tresume()
+    #define CACHE_LINE_SIZE     128
     // TODO:
     //#define HTM_ABORT_CONFLICT(c)
     //#define HTM_ABORT_OVERFLOW(c)
@@ -48,29 +50,66 @@
 typedef struct _tm_stats_t {
     int64_t cycles;        // total cycles in lock mode
     int64_t tm_cycles;     // total cycles in TM mode
-    int32_t locks;         // # of lock acqs
-    int32_t tries;         // # of tm_begins
-    int32_t stops;         // # of self-stop
-    int32_t commits;       // # of tm_ends
-    int32_t overflows;     // overflow aborts
-    int32_t conflicts;     // conflict aborts
+    int64_t locks;         // # of lock acqs
+    int64_t tries;         // # of tm_begins
+    int64_t stops;         // # of self-stop
+    int64_t commits;       // # of tm_ends
+    int64_t overflows;     // overflow aborts
+    int64_t conflicts;     // conflict aborts
+    int64_t explicits;     // explicit aborts, self-stops included
     int32_t threads;       // number of threads
+    int32_t tid;           // owning thread, 0 while on the free list
     struct _tm_stats_t* volatile next;
+    struct _tm_stats_t* free_next;
 } __attribute__ ((aligned(128))) tm_stats_t;
 
 // initialized in txutil.c
-extern tm_stats_t* tm_stats_head;      // master thread's local state
+extern tm_stats_t* tm_stats_head;      // every thread's stats, in use or free
 extern __thread tm_stats_t* my_tm_stats; // thread-local stats
 extern tm_stats_t tm_stats;             // global stats, updated only when a thread exits
 
+// this thread's stats, created on its first lock (tl_thread_stats in txlock.c)
+tm_stats_t* tl_thread_stats();
+#define MY_TM_STATS (__builtin_expect(my_tm_stats != 0, 1) ? my_tm_stats : tl_thread_stats())
+
+// Live stats segment, /dev/shm/txlock.<pid> with LIBTXLOCK_SHM=1: this
+// header, then num_slots tm_stats_t, the first used_slots of them taken by
+// threads of the process. A slot is zeroed and its tid cleared when its
+// thread exits, and its counts move to `exited`. The pointers are
+// meaningless outside the process.
+#define TL_SHM_MAGIC   0x6b6c7874 // "txlk"
+#define TL_SHM_VERSION 2
+typedef struct _tl_shm_header_t {
+    volatile uint32_t magic; // written last
+    uint32_t version;
+    int32_t pid;
+    int32_t stats_level;
+    int32_t num_slots;
+    volatile int32_t used_slots;
+    char lock_name[32];
+    tm_stats_t exited;       // the threads that are gone
+} __attribute__ ((aligned(128))) tl_shm_header_t;
+
+// Stats level: 0 off, 1 counts, 2 counts and rdtsc timing. txlock_types.c
+// is built at every level and LIBTXLOCK_STATS picks one at load time; for
+// everything else TM_NO_PROFILING and TM_PROFILE_RDTSC still select it.
 //#define TM_NO_PROFILING
 //#define TM_PROFILE_RDTSC
+#ifndef TM_STATS_LEVEL
+    #if defined(TM_NO_PROFILING)
+        #define TM_STATS_LEVEL 0
+    #elif defined(TM_PROFILE_RDTSC)
+        #define TM_STATS_LEVEL 2
+    #else
+        #define TM_STATS_LEVEL 1
+    #endif
+#endif
 
-#ifdef TM_NO_PROFILING
+#if TM_STATS_LEVEL == 0
 #define TM_STATS_ADD(stat, value)
 #define TM_STATS_SUB(stat, value)
 #else
-    #ifdef TM_PROFILE_RDTSC
+    #if TM_STATS_LEVEL >= 2
         #define RDTSC() rdtsc()
     #else
         #define RDTSC() 0
@@ -80,6 +119,10 @@ extern tm_stats_t tm_stats;             // global stats, updated only when a thr
 #endif
 
 
+// TSC ticks per ns, measured by tl_calibrate_tsc (txutil.c); 0 until then
+extern double tl_tsc_per_ns;
+void tl_calibrate_tsc();
+
 // ASM optimized synchronization
 #if defined(__powerpc__) || defined(__powerpc64__)
     //#define HMT_very_low()   __asm volatile("or 31,31,31   # very low priority")
@@ -92,6 +135,8 @@ extern tm_stats_t tm_stats;             // global stats, updated only when a thr
 extern int SPIN_INIT;
 extern int SPIN_CELL;
 extern float SPIN_FACTOR;
+extern int SPIN_PARK;
+#define SPIN_PARK_MAX (1<<16)
 inline int spin_begin() { return SPIN_INIT; }
 inline int spin_wait(int s) {
     for (int i=0; i<s; i++)
@@ -128,23 +173,26 @@ int inline ul_unlock(utility_lock_t *lk) {
 extern __thread void * volatile spec_entry;
 
 
-// how to enter HTM
-int inline enter_htm(void* primitive){
+// how to enter HTM, static as it counts at the stats level of the caller
+static inline int enter_htm(void* primitive){
     spec_entry = primitive;
     int ret;
-    TM_STATS_ADD(my_tm_stats->tries, 1);
-    TM_STATS_SUB(my_tm_stats->tm_cycles, RDTSC());
+    TM_STATS_ADD(MY_TM_STATS->tries, 1);
+    TM_STATS_SUB(MY_TM_STATS->tm_cycles, RDTSC());
     if ((ret = HTM_SIMPLE_BEGIN()) == HTM_SUCCESSFUL) {
         return 0;
     }
     // abort
-    TM_STATS_ADD(my_tm_stats->tm_cycles, RDTSC());
+    TM_STATS_ADD(MY_TM_STATS->tm_cycles, RDTSC());
     if (HTM_ABORT_CONFLICT(ret))
-        TM_STATS_ADD(my_tm_stats->conflicts, 1);
+        TM_STATS_ADD(MY_TM_STATS->conflicts, 1);
     else if (HTM_ABORT_OVERFLOW(ret))
-        TM_STATS_ADD(my_tm_stats->overflows, 1);
-    else if (HTM_ABORT_EXPLICIT(ret) && _XABORT_CODE(ret)==7)// self aborts
-        TM_STATS_ADD(my_tm_stats->stops, 1);
+        TM_STATS_ADD(MY_TM_STATS->overflows, 1);
+    else if (HTM_ABORT_EXPLICIT(ret)) {
+        TM_STATS_ADD(MY_TM_STATS->explicits, 1);
+        if (_XABORT_CODE(ret)==7)// self aborts
+            TM_STATS_ADD(MY_TM_STATS->stops, 1);
+    }
     spec_entry = 0;
     return 1;
 }
@@ -154,6 +202,29 @@ extern uint32_t TK_MIN_DISTANCE;
 extern uint32_t TK_MAX_DISTANCE;
 extern uint32_t TK_NUM_TRIES;
 extern bool TM_COND_VARS;
+extern bool TM_SEQ_READS;
 extern bool USE_PTHREAD_COND_VARS;
+extern uint32_t COHORT_BATCH;
+
+// Call-site policy (LIBTXLOCK_POLICY, see txprofile.c), set by the thread
+// around acquisitions from the call sites it names. The mutex algorithms
+// read their tuning through these, so the rest keep the TK_* defaults.
+typedef struct _tl_policy_t {
+    uint32_t num_tries;
+    uint32_t min_distance;
+    uint32_t max_distance;
+    int park_spin;
+} tl_policy_t;
+extern __thread const tl_policy_t* tl_policy;
+#define TL_NUM_TRIES    (tl_policy ? tl_policy->num_tries : TK_NUM_TRIES)
+#define TL_MIN_DISTANCE (tl_policy ? tl_policy->min_distance : TK_MIN_DISTANCE)
+#define TL_MAX_DISTANCE (tl_policy ? tl_policy->max_distance : TK_MAX_DISTANCE)
+#define TL_PARK_SPIN    (tl_policy ? tl_policy->park_spin : SPIN_PARK)
+
+// NUMA topology (txutil.c)
+#define TL_MAX_NUMA_NODES 64
+extern int tl_numa_nodes;  // number of (possibly faked) nodes
+void tl_numa_init();
+int tl_numa_node();        // node of the calling thread
 
 #endif